@@ -14,6 +14,7 @@
 #include <services/rpc/assetrpc.h>
 #include <rpc/server.h>
 #include <chainparams.h>
+#include <mempoolaccept.h>
 extern std::string EncodeDestination(const CTxDestination& dest);
 extern CTxDestination DecodeDestination(const std::string& str);
 extern UniValue ValueFromAmount(const CAmount& amount);
@@ -27,7 +28,330 @@ CCriticalSection cs_setethstatus;
 using namespace std;
 AssetBalanceMap mempoolMapAssetBalances GUARDED_BY(cs_assetallocationmempoolbalance);
 ArrivalTimesMapImpl arrivalTimesMap GUARDED_BY(cs_assetallocationarrival);
+// sender addresses with a double spend on record, filled and cleared by assetconsensus.cpp; admission also checks the sharded table below
 std::unordered_set<std::string> assetAllocationConflicts GUARDED_BY(cs_assetallocationconflicts);
+/** Binary form of an asset allocation tuple (asset guid, witness version and program) */
+struct AssetAllocationKey {
+    uint32_t nAsset;
+    unsigned char nVersion;
+    unsigned char nProgramSize;
+    // CWitnessAddress::IsValid caps programs at 40 bytes
+    unsigned char vchProgram[40];
+
+    explicit AssetAllocationKey(const CAssetAllocationTuple& tuple) : nAsset(tuple.nAsset), nVersion(tuple.witnessAddress.nVersion), vchProgram{}
+    {
+        const std::vector<unsigned char>& vch = tuple.witnessAddress.vchWitnessProgram;
+        nProgramSize = std::min<size_t>(vch.size(), sizeof(vchProgram));
+        std::copy(vch.begin(), vch.begin() + nProgramSize, vchProgram);
+    }
+    bool operator==(const AssetAllocationKey& other) const
+    {
+        return nAsset == other.nAsset && nVersion == other.nVersion && nProgramSize == other.nProgramSize &&
+            std::equal(vchProgram, vchProgram + nProgramSize, other.vchProgram);
+    }
+};
+struct AssetAllocationKeyHasher {
+    const uint64_t m_k0, m_k1;
+    AssetAllocationKeyHasher() : m_k0(GetRand(std::numeric_limits<uint64_t>::max())), m_k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+    size_t operator()(const AssetAllocationKey& key) const
+    {
+        return CSipHasher(m_k0, m_k1).Write(key.nAsset).Write((uint64_t)key.nVersion << 8 | key.nProgramSize).Write(key.vchProgram, key.nProgramSize).Finalize();
+    }
+};
+/**
+ * Senders that have double spent an asset allocation in the mempool (ZDAG).
+ * Keyed by the binary tuple (asset guid, witness version and program) so a
+ * lookup builds no string, and sharded so concurrent admissions only
+ * contend when they hit the same shard. Every entry remembers when it was
+ * added so Prune can drop them once blocks have settled the double spend.
+ */
+class CAssetAllocationConflicts
+{
+public:
+    static constexpr size_t NUM_SHARDS = 64;
+
+    bool Contains(const CAssetAllocationTuple& tuple) const;
+    void Insert(const CAssetAllocationTuple& tuple, int64_t nTime);
+    size_t Prune(int64_t nCutoff);
+    size_t Size() const;
+
+private:
+    typedef AssetAllocationKey Key;
+    typedef AssetAllocationKeyHasher KeyHasher;
+    struct Shard {
+        mutable Mutex m_mutex;
+        std::unordered_map<Key, int64_t, KeyHasher> m_map GUARDED_BY(m_mutex);
+    };
+
+    Shard& GetShard(const Key& key) const { return m_shards[m_shard_hasher(key) % NUM_SHARDS]; }
+
+    const KeyHasher m_shard_hasher;
+    mutable Shard m_shards[NUM_SHARDS];
+};
+
+bool CAssetAllocationConflicts::Contains(const CAssetAllocationTuple& tuple) const
+{
+    const Key key(tuple);
+    Shard& shard = GetShard(key);
+    LOCK(shard.m_mutex);
+    return shard.m_map.count(key) > 0;
+}
+
+void CAssetAllocationConflicts::Insert(const CAssetAllocationTuple& tuple, int64_t nTime)
+{
+    const Key key(tuple);
+    Shard& shard = GetShard(key);
+    LOCK(shard.m_mutex);
+    // keep the time of the first double spend of a sender
+    shard.m_map.emplace(key, nTime);
+}
+
+size_t CAssetAllocationConflicts::Prune(int64_t nCutoff)
+{
+    size_t nPruned = 0;
+    for (Shard& shard : m_shards) {
+        LOCK(shard.m_mutex);
+        for (auto it = shard.m_map.begin(); it != shard.m_map.end();) {
+            if (it->second <= nCutoff) {
+                it = shard.m_map.erase(it);
+                nPruned++;
+            } else {
+                ++it;
+            }
+        }
+        // give the buckets of an emptied shard back
+        if (shard.m_map.empty()) {
+            std::unordered_map<Key, int64_t, KeyHasher>().swap(shard.m_map);
+        }
+    }
+    return nPruned;
+}
+
+size_t CAssetAllocationConflicts::Size() const
+{
+    size_t nSize = 0;
+    for (const Shard& shard : m_shards) {
+        LOCK(shard.m_mutex);
+        nSize += shard.m_map.size();
+    }
+    return nSize;
+}
+
+CAssetAllocationConflicts assetAllocationConflictTable;
+
+bool AssetAllocationHasConflict(const CAssetAllocationTuple& sender)
+{
+    if (assetAllocationConflictTable.Contains(sender))
+        return true;
+    LOCK(cs_assetallocationconflicts);
+    // only build the tuple string if assetconsensus.cpp recorded anything
+    return !assetAllocationConflicts.empty() && assetAllocationConflicts.count(sender.ToString()) > 0;
+}
+CAssetAllocationTuple GetAssetAllocationConflictActor(const CAssetAllocation& theAssetAllocation, int nVersion)
+{
+    // the sender of a burn to allocation is "burn", GetActorsFromAssetAllocationTx names the receiver
+    if(nVersion == SYSCOIN_TX_VERSION_SYSCOIN_BURN_TO_ALLOCATION)
+        return CAssetAllocationTuple(theAssetAllocation.assetAllocationTuple.nAsset, theAssetAllocation.listSendingAllocationAmounts[0].first);
+    return theAssetAllocation.assetAllocationTuple;
+}
+void AddAssetAllocationConflict(const CAssetAllocationTuple& sender, int64_t nTime)
+{
+    assetAllocationConflictTable.Insert(sender, nTime);
+}
+size_t PruneAssetAllocationConflicts(int64_t nCutoff)
+{
+    return assetAllocationConflictTable.Prune(nCutoff);
+}
+size_t GetAssetAllocationConflictsSize()
+{
+    size_t nSize = assetAllocationConflictTable.Size();
+    LOCK(cs_assetallocationconflicts);
+    return nSize + assetAllocationConflicts.size();
+}
+/** Default for -zdagevidencemaxsize, in MiB */
+static const unsigned int DEFAULT_ZDAG_EVIDENCE_MAX_SIZE = 8;
+/**
+ * Evidence of the ZDAG double spends of every sender: which inputs were spent
+ * twice, by which transactions and when. Each sender gets a fixed ring, so a
+ * sender spamming double spends only overwrites its own oldest records, and
+ * senders are evicted least recently updated first once the store is charged
+ * more than its byte cap. Lookups do not count as use, so querying a sender
+ * does not keep it around. Records are only added on the double spend path,
+ * so a single lock is enough.
+ */
+class CAssetAllocationDoubleSpendEvidence
+{
+public:
+    static constexpr size_t RECORDS_PER_SENDER = 16;
+
+    void SetMaxBytes(size_t nMaxBytes);
+    /** Add the records of vEvidence not held yet, and copy them to vAdded */
+    void Add(const CAssetAllocationTuple& sender, const std::vector<ZdagDoubleSpendEvidence>& vEvidence, std::vector<ZdagDoubleSpendEvidence>& vAdded);
+    bool Get(const CAssetAllocationTuple& sender, std::vector<ZdagDoubleSpendEvidence>& vEvidence) const;
+    ZdagEvidenceStats GetStats() const;
+
+    std::atomic<bool> m_publish{false};
+
+private:
+    struct Sender {
+        std::array<ZdagDoubleSpendEvidence, RECORDS_PER_SENDER> m_ring;
+        size_t m_next{0}; // slot the next record goes in
+        size_t m_count{0};
+        std::list<AssetAllocationKey>::iterator m_lru;
+    };
+    // Memory charged for a sender: its ring plus its map and list nodes
+    static constexpr size_t SENDER_BYTES = sizeof(Sender) + 2 * sizeof(AssetAllocationKey) + 6 * sizeof(void*);
+
+    void EvictLocked(size_t nMaxSenders) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    mutable Mutex m_mutex;
+    std::unordered_map<AssetAllocationKey, Sender, AssetAllocationKeyHasher> m_senders GUARDED_BY(m_mutex);
+    // least recently updated sender first
+    std::list<AssetAllocationKey> m_lru GUARDED_BY(m_mutex);
+    size_t m_max_bytes GUARDED_BY(m_mutex){DEFAULT_ZDAG_EVIDENCE_MAX_SIZE << 20};
+    uint64_t m_records GUARDED_BY(m_mutex){0};
+    uint64_t m_evictions GUARDED_BY(m_mutex){0};
+};
+
+void CAssetAllocationDoubleSpendEvidence::SetMaxBytes(size_t nMaxBytes)
+{
+    LOCK(m_mutex);
+    m_max_bytes = nMaxBytes;
+    EvictLocked(m_max_bytes / SENDER_BYTES);
+}
+
+void CAssetAllocationDoubleSpendEvidence::EvictLocked(size_t nMaxSenders)
+{
+    while (m_senders.size() > nMaxSenders) {
+        auto it = m_senders.find(m_lru.front());
+        m_records -= it->second.m_count;
+        m_senders.erase(it);
+        m_lru.pop_front();
+        m_evictions++;
+    }
+}
+
+void CAssetAllocationDoubleSpendEvidence::Add(const CAssetAllocationTuple& sender, const std::vector<ZdagDoubleSpendEvidence>& vEvidence, std::vector<ZdagDoubleSpendEvidence>& vAdded)
+{
+    const AssetAllocationKey key(sender);
+    LOCK(m_mutex);
+    const size_t nMaxSenders = m_max_bytes / SENDER_BYTES;
+    if (nMaxSenders == 0)
+        return;
+    auto it = m_senders.find(key);
+    if (it == m_senders.end()) {
+        // make room first so the new sender is never the one evicted
+        EvictLocked(nMaxSenders - 1);
+        it = m_senders.emplace(key, Sender()).first;
+        it->second.m_lru = m_lru.insert(m_lru.end(), key);
+    } else {
+        m_lru.splice(m_lru.end(), m_lru, it->second.m_lru);
+    }
+    Sender& entry = it->second;
+    for (const ZdagDoubleSpendEvidence& evidence : vEvidence) {
+        // the same double spend is seen again when the tx is relayed back to us
+        bool fKnown = false;
+        for (size_t i = 0; i < entry.m_count; i++) {
+            if (entry.m_ring[i].m_txid == evidence.m_txid && entry.m_ring[i].m_prevout == evidence.m_prevout) {
+                fKnown = true;
+                break;
+            }
+        }
+        if (fKnown)
+            continue;
+        entry.m_ring[entry.m_next] = evidence;
+        entry.m_next = (entry.m_next + 1) % RECORDS_PER_SENDER;
+        if (entry.m_count < RECORDS_PER_SENDER) {
+            entry.m_count++;
+            m_records++;
+        }
+        vAdded.push_back(evidence);
+    }
+}
+
+bool CAssetAllocationDoubleSpendEvidence::Get(const CAssetAllocationTuple& sender, std::vector<ZdagDoubleSpendEvidence>& vEvidence) const
+{
+    const AssetAllocationKey key(sender);
+    LOCK(m_mutex);
+    auto it = m_senders.find(key);
+    if (it == m_senders.end())
+        return false;
+    const Sender& entry = it->second;
+    // the oldest record is the one the next one overwrites once the ring is full
+    const size_t nFirst = entry.m_count < RECORDS_PER_SENDER ? 0 : entry.m_next;
+    for (size_t i = 0; i < entry.m_count; i++) {
+        vEvidence.push_back(entry.m_ring[(nFirst + i) % RECORDS_PER_SENDER]);
+    }
+    return true;
+}
+
+ZdagEvidenceStats CAssetAllocationDoubleSpendEvidence::GetStats() const
+{
+    LOCK(m_mutex);
+    ZdagEvidenceStats stats;
+    stats.m_senders = m_senders.size();
+    stats.m_records = m_records;
+    stats.m_bytes = m_senders.size() * SENDER_BYTES;
+    stats.m_max_bytes = m_max_bytes;
+    stats.m_evictions = m_evictions;
+    return stats;
+}
+
+CAssetAllocationDoubleSpendEvidence assetAllocationDoubleSpendEvidence;
+
+void StartZdagEvidenceStore()
+{
+    assetAllocationDoubleSpendEvidence.SetMaxBytes(std::max<int64_t>(0, gArgs.GetArg("-zdagevidencemaxsize", DEFAULT_ZDAG_EVIDENCE_MAX_SIZE)) << 20);
+    assetAllocationDoubleSpendEvidence.m_publish = gArgs.IsArgSet("-zmqpubassetallocationdoublespend");
+}
+void AddAssetAllocationDoubleSpendEvidence(const CAssetAllocationTuple& sender, const std::vector<ZdagDoubleSpendEvidence>& vEvidence)
+{
+    std::vector<ZdagDoubleSpendEvidence> vAdded;
+    assetAllocationDoubleSpendEvidence.Add(sender, vEvidence, vAdded);
+    if (vAdded.empty() || !assetAllocationDoubleSpendEvidence.m_publish)
+        return;
+    const std::string strAddress = sender.witnessAddress.ToString();
+    for (const ZdagDoubleSpendEvidence& evidence : vAdded) {
+        UniValue oEvidence(UniValue::VOBJ);
+        oEvidence.__pushKV("asset_guid", sender.nAsset);
+        oEvidence.__pushKV("address", strAddress);
+        oEvidence.__pushKV("txid", evidence.m_txid.GetHex());
+        oEvidence.__pushKV("conflicting_txid", evidence.m_conflicting_txid.GetHex());
+        oEvidence.__pushKV("prevout_txid", evidence.m_prevout.hash.GetHex());
+        oEvidence.__pushKV("prevout_n", (int)evidence.m_prevout.n);
+        oEvidence.__pushKV("time", evidence.m_time);
+        GetMainSignals().NotifySyscoinUpdate(oEvidence.write().c_str(), "assetallocationdoublespend");
+    }
+}
+bool GetAssetAllocationDoubleSpendEvidence(const CAssetAllocationTuple& sender, std::vector<ZdagDoubleSpendEvidence>& vEvidence)
+{
+    return assetAllocationDoubleSpendEvidence.Get(sender, vEvidence);
+}
+ZdagEvidenceStats GetZdagEvidenceStats()
+{
+    return assetAllocationDoubleSpendEvidence.GetStats();
+}
+ZdagMempoolStateStats GetZdagMempoolStateStats(const CTxMemPool& pool)
+{
+    ZdagMempoolStateStats stats{};
+    {
+        LOCK(cs_assetallocationmempoolbalance);
+        stats.m_balances = mempoolMapAssetBalances.size();
+        for (const auto& balance : mempoolMapAssetBalances) {
+            if (balance.second < 0)
+                stats.m_negative_balances++;
+        }
+    }
+    LOCK2(pool.cs, cs_assetallocationarrival);
+    for (const auto& sender : arrivalTimesMap) {
+        for (const auto& arrival : sender.second) {
+            stats.m_arrivals++;
+            if (!pool.exists(arrival.first))
+                stats.m_stale_arrivals++;
+        }
+    }
+    return stats;
+}
 string CWitnessAddress::ToString() const {
     if (vchWitnessProgram.size() <= 4 && stringFromVch(vchWitnessProgram) == "burn")
         return "burn";
@@ -873,7 +1197,7 @@ template <typename Stream, typename Operation>
 void CAssetAllocation::SerializationOp(Stream& s, Operation ser_action) {
     READWRITE(assetAllocationTuple);
     READWRITE(listSendingAllocationAmounts);
-    if(::ChainActive().Tip()->nHeight <= Params().GetConsensus().nBridgeStartBlock){
+    if(IsTipBeforeBridgeStart()){
         CAmount nBalance;
         READWRITE(nBalance);
         READWRITE(lockedOutpoint);
@@ -890,7 +1214,7 @@ template <typename Stream, typename Operation>
 void CAssetAllocationDBEntry::SerializationOp(Stream& s, Operation ser_action) {
     READWRITE(assetAllocationTuple);
     READWRITE(nBalance);
-    if(::ChainActive().Tip()->nHeight <= Params().GetConsensus().nBridgeStartBlock){
+    if(IsTipBeforeBridgeStart()){
         RangeAmountTuples listSendingAllocationAmounts;
         READWRITE(listSendingAllocationAmounts);
         READWRITE(lockedOutpoint);
@@ -0,0 +1,134 @@
+BOOST_AUTO_TEST_CASE(generate_asset_reorg_stress)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_asset_reorg_stress...\n");
+    GenerateBlocks(5, "node1");
+    GenerateBlocks(5, "node3");
+    // user modifiable variables
+
+    // blocks full of asset allocation sends to build, and how many of them to disconnect
+    int numBlocks = 10;
+    int reorgDepth = 5;
+    BOOST_CHECK(reorgDepth >= 1 && reorgDepth <= numBlocks);
+
+    // every block holds numAssets assetallocationsendmany transactions of numberOfAssetSendsPerTx receivers each
+    int numAssets = 10;
+    int numberOfAssetSendsPerTx = 100;
+    BOOST_CHECK(numberOfAssetSendsPerTx >= 1 && numberOfAssetSendsPerTx <= 250);
+
+    vector<string> vecAssets;
+    vector<string> vecFundedAddresses;
+    vector<string> unfundedAccounts;
+
+    // PHASE 1:  GENERATE UNFUNDED ADDRESSES FOR RECIPIENTS TO ASSETALLOCATIONSEND
+    tfm::format(std::cout,"Reorg stress test: %d blocks of %d assetallocationsendmany transactions (%d receivers each), disconnecting %d blocks\n\n", numBlocks, numAssets, numberOfAssetSendsPerTx, reorgDepth);
+    tfm::format(std::cout,"creating %d unfunded addresses...\n", numberOfAssetSendsPerTx);
+    for(int i =0;i<numberOfAssetSendsPerTx;i++){
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+        unfundedAccounts.emplace_back(r.get_str());
+    }
+
+    // PHASE 2:  GENERATE FUNDED ADDRESSES FOR CREATING AND SENDING ASSETS
+    tfm::format(std::cout,"creating %d funded accounts...\n", numAssets);
+    string sendManyString = "";
+    for(int i =0;i<numAssets;i++){
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+        string fundedAccount = r.get_str();
+        if(sendManyString != "")
+            sendManyString += ",";
+        // enough to pay the fees of one send per block and the mempool round
+        sendManyString += "\"" + fundedAccount + "\":" + itostr(numBlocks + 2);
+        vecFundedAddresses.push_back(fundedAccount);
+    }
+    CallExtRPC("node1", "sendmany", "\"\",{" + sendManyString + "}");
+    GenerateBlocks(5);
+
+    // PHASE 3:  CREATE ASSETS AND SEND THEM TO THE FUNDED ADDRESSES
+    const string assetSupply = itostr((numBlocks + 1) * numberOfAssetSendsPerTx);
+    tfm::format(std::cout,"creating %d sender assets...\n", numAssets);
+    for(int i =0;i<numAssets;i++){
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "assetnew" , "\"" +  vecFundedAddresses[i] + "\",\"reorg\",\"''\",\"''\",8," + assetSupply + "," + assetSupply + ",31,{},\"''\""));
+        string guid = itostr(find_value(r.get_obj(), "asset_guid").get_uint());
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "signrawtransactionwithwallet", "\"" + find_value(r.get_obj(), "hex").get_str() + "\""));
+        string hex_str = find_value(r.get_obj(), "hex").get_str();
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransaction" , "\"" + hex_str + "\""));
+        vecAssets.push_back(guid);
+    }
+    GenerateBlocks(5);
+    string assetSendBatch = "";
+    for(int i =0;i<numAssets;i++){
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "assetsendmany" ,  vecAssets[i] + ",[{\"address\":\"" + vecFundedAddresses[i] + "\",\"amount\":" + assetSupply + "}],\"''\""));
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "signrawtransactionwithwallet", "\"" +  find_value(r.get_obj(), "hex").get_str() + "\""));
+        if(assetSendBatch != "")
+            assetSendBatch += ",";
+        assetSendBatch += "\"" + find_value(r.get_obj(), "hex").get_str() + "\"";
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions" , "[" + assetSendBatch + "]"));
+    GenerateBlocks(5);
+
+    // PHASE 4:  BUILD THE CHAIN, numBlocks BLOCKS OF ASSET ALLOCATION SENDS, AND ONE MORE ROUND LEFT IN THE MEMPOOL
+    string assetAllocationSendMany = "";
+    for (int j = 0; j < numberOfAssetSendsPerTx; j++) {
+        if(assetAllocationSendMany != "")
+            assetAllocationSendMany += ",";
+        assetAllocationSendMany += "{\"address\":\"" + unfundedAccounts[j] + "\",\"amount\":1}";
+    }
+    for(int nBlock = 0; nBlock <= numBlocks; nBlock++){
+        string assetAllocationBatch = "";
+        for(int i =0;i<numAssets;i++){
+            BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "assetallocationsendmany" , vecAssets[i] + ",\"" + vecFundedAddresses[i] + "\",[" + assetAllocationSendMany + "],\"''\""));
+            BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "signrawtransactionwithwallet" , "\"" + find_value(r.get_obj(), "hex").get_str() + "\""));
+            if(assetAllocationBatch != "")
+                assetAllocationBatch += ",";
+            assetAllocationBatch += "\"" + find_value(r.get_obj(), "hex").get_str() + "\"";
+        }
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions" , "[" + assetAllocationBatch + "]"));
+        UniValue sendResults = r.get_array();
+        for(size_t i =0;i<sendResults.size();i++){
+            BOOST_CHECK(find_value(sendResults[i].get_obj(), "allowed").get_bool());
+        }
+        if(nBlock < numBlocks)
+            GenerateBlocks(1, "node1");
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolinfo"));
+    const int64_t mempoolSizeBefore = find_value(r.get_obj(), "size").get_int64();
+    BOOST_CHECK(mempoolSizeBefore >= numAssets);
+
+    // PHASE 5:  DISCONNECT reorgDepth BLOCKS
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getblockcount"));
+    const int nHeight = r.get_int();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getblockhash", itostr(nHeight - reorgDepth + 1)));
+    const string forkBlockHash = r.get_str();
+    tfm::format(std::cout,"disconnecting %d blocks from height %d...\n", reorgDepth, nHeight);
+    const int64_t startreorg = GetTimeMicros();
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "invalidateblock", "\"" + forkBlockHash + "\"", false));
+    const int64_t endreorg = GetTimeMicros();
+
+    // PHASE 6:  DISPLAY RESULTS AND CHECK THE MEMPOOL AND ZDAG STATE
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolreorginfo"));
+    UniValue reorgInfo = r.get_obj();
+    const UniValue& micros = find_value(reorgInfo, "micros").get_obj();
+    tfm::format(std::cout,"elapsed time in invalidateblock: %lld\n", endreorg-startreorg);
+    tfm::format(std::cout,"disconnected %lld transactions, %lld resurrected, %lld dropped, peak mempool usage %lld bytes\n",
+        find_value(reorgInfo, "disconnected").get_int64(), find_value(reorgInfo, "resurrected").get_int64(),
+        find_value(reorgInfo, "dropped").get_int64(), find_value(reorgInfo, "peakusage").get_int64());
+    tfm::format(std::cout,"resurrect %lld, updatedescendants %lld, removeforreorg %lld, limit %lld, total %lld (microseconds)\n",
+        find_value(micros, "resurrect").get_int64(), find_value(micros, "updatedescendants").get_int64(),
+        find_value(micros, "removeforreorg").get_int64(), find_value(micros, "limit").get_int64(), find_value(micros, "total").get_int64());
+    // every disconnected allocation send spends a confirmed output, so it must make it back in
+    BOOST_CHECK(find_value(reorgInfo, "disconnected").get_int64() >= reorgDepth * numAssets);
+    BOOST_CHECK(find_value(reorgInfo, "resurrected").get_int64() >= reorgDepth * numAssets);
+    BOOST_CHECK(find_value(find_value(reorgInfo, "zdag").get_obj(), "consistent").get_bool());
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolinfo"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "size").get_int64(), mempoolSizeBefore + find_value(reorgInfo, "resurrected").get_int64());
+
+    // PHASE 7:  RECONNECT THE BLOCKS, THE MEMPOOL MUST BE BACK TO WHERE IT WAS
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "reconsiderblock", "\"" + forkBlockHash + "\"", false));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getblockcount"));
+    BOOST_CHECK_EQUAL(r.get_int(), nHeight);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolinfo"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "size").get_int64(), mempoolSizeBefore);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolreorginfo"));
+    BOOST_CHECK(find_value(find_value(r.get_obj(), "zdag").get_obj(), "consistent").get_bool());
+    GenerateBlocks(1, "node1");
+}
@@ -0,0 +1,167 @@
+// fund a new address on node, create an asset and send nSupply of it to the address, returning the asset guid
+static string CreateZdagSender(const string& node, const string& address, int nSupply)
+{
+    UniValue r;
+    BOOST_CHECK_NO_THROW(CallExtRPC(node, "sendtoaddress", "\"" + address + "\",10"));
+    GenerateBlocks(1, node);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "assetnew" , "\"" + address + "\",\"zdag\",\"''\",\"''\",8," + itostr(nSupply) + "," + itostr(nSupply) + ",31,{},\"''\""));
+    const string guid = itostr(find_value(r.get_obj(), "asset_guid").get_uint());
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "signrawtransactionwithwallet", "\"" + find_value(r.get_obj(), "hex").get_str() + "\""));
+    BOOST_CHECK_NO_THROW(CallExtRPC(node, "sendrawtransaction" , "\"" + find_value(r.get_obj(), "hex").get_str() + "\""));
+    GenerateBlocks(1, node);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "assetsendmany" , guid + ",[{\"address\":\"" + address + "\",\"amount\":" + itostr(nSupply) + "}],\"''\""));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "signrawtransactionwithwallet", "\"" + find_value(r.get_obj(), "hex").get_str() + "\""));
+    BOOST_CHECK_NO_THROW(CallExtRPC(node, "sendrawtransaction" , "\"" + find_value(r.get_obj(), "hex").get_str() + "\""));
+    GenerateBlocks(1, node);
+    return guid;
+}
+// sign an allocation send of nAmount of guid from address to a new address without sending it
+static string CreateAllocationSend(const string& node, const string& guid, const string& address, int nAmount)
+{
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "getnewaddress"));
+    const string receiver = r.get_str();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "assetallocationsendmany" , guid + ",\"" + address + "\",[{\"address\":\"" + receiver + "\",\"amount\":" + itostr(nAmount) + "}],\"''\""));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "signrawtransactionwithwallet" , "\"" + find_value(r.get_obj(), "hex").get_str() + "\""));
+    return find_value(r.get_obj(), "hex").get_str();
+}
+// spend the whole balance of address twice, returning the txid of the double spend
+static string SendZdagDoubleSpend(const string& node, const string& guid, const string& address, int nBalance)
+{
+    UniValue r;
+    const string spend = CreateAllocationSend(node, guid, address, nBalance);
+    const string doubleSpend = CreateAllocationSend(node, guid, address, nBalance);
+    BOOST_CHECK_NO_THROW(CallExtRPC(node, "sendrawtransaction", "\"" + spend + "\""));
+    BOOST_CHECK_NO_THROW(CallExtRPC(node, "sendrawtransaction", "\"" + doubleSpend + "\""));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "decoderawtransaction", "\"" + doubleSpend + "\""));
+    return find_value(r.get_obj(), "txid").get_str();
+}
+
+BOOST_AUTO_TEST_CASE(generate_asset_zdag_removal_queue)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_asset_zdag_removal_queue...\n");
+    GenerateBlocks(5, "node1");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string guid = CreateZdagSender("node1", address, 100);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getzdagremovalinfo"));
+    const int64_t nQueued = find_value(r.get_obj(), "queued").get_int64();
+    const int64_t nLegacy = find_value(r.get_obj(), "legacy").get_int64();
+
+    SendZdagDoubleSpend("node1", guid, address, 100);
+    // nothing in this tree polls the queue, so the double spend goes to the existing removal loop
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getzdagremovalinfo"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "queued").get_int64(), nQueued + 1);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "legacy").get_int64(), nLegacy + 1);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "pending").get_int64(), 0);
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_asset_zdag_one_double_spend_per_sender)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_asset_zdag_one_double_spend_per_sender...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string guid = CreateZdagSender("node1", address, 100);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getzdagremovalinfo"));
+    const int64_t nConflicts = find_value(r.get_obj(), "conflicts").get_int64();
+
+    // all three spend the same inputs
+    const string spend = CreateAllocationSend("node1", guid, address, 100);
+    const string doubleSpend = CreateAllocationSend("node1", guid, address, 100);
+    const string tripleSpend = CreateAllocationSend("node1", guid, address, 100);
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + spend + "\""));
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + doubleSpend + "\""));
+    // the double spend put the sender on record
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getzdagremovalinfo"));
+    BOOST_CHECK(find_value(r.get_obj(), "conflicts").get_int64() > nConflicts);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrecentrejectsinfo"));
+    const int64_t nInserts = find_value(r.get_obj(), "inserts").get_int64();
+    // so it may not double spend again
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + tripleSpend + "\"]"));
+    BOOST_CHECK(!find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+    // which depends on the ZDAG mempool state, so the reject is not remembered
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrecentrejectsinfo"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "inserts").get_int64(), nInserts);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + tripleSpend + "\"]"));
+    BOOST_CHECK(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str() != "txn-recently-rejected");
+    BOOST_CHECK_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tripleSpend + "\""), runtime_error);
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_asset_zdag_double_spend_evidence)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_asset_zdag_double_spend_evidence...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string guid = CreateZdagSender("node1", address, 100);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "assetallocationdoublespends", guid + ",\"" + address + "\""));
+    BOOST_CHECK(find_value(r.get_obj(), "evidence").get_array().empty());
+    BOOST_CHECK(find_value(r.get_obj(), "maxbytes").get_int64() > 0);
+
+    const string txid = SendZdagDoubleSpend("node1", guid, address, 100);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "assetallocationdoublespends", guid + ",\"" + address + "\""));
+    const UniValue& evidence = find_value(r.get_obj(), "evidence").get_array();
+    BOOST_CHECK(!evidence.empty());
+    for (size_t i = 0; i < evidence.size(); i++) {
+        BOOST_CHECK_EQUAL(find_value(evidence[i].get_obj(), "txid").get_str(), txid);
+    }
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_asset_zdag_accept_stats)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_asset_zdag_accept_stats...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string guid = CreateZdagSender("node1", address, 100);
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "getmempoolacceptstats", "true"));
+    const string send = CreateAllocationSend("node1", guid, address, 10);
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + send + "\""));
+    // allocation sends are timed apart from plain transactions, CheckSyscoinInputs within consensusscripts
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolacceptstats"));
+    const UniValue& stages = find_value(r.get_obj(), "stages").get_obj();
+    BOOST_CHECK_EQUAL(find_value(find_value(find_value(stages, "consensusscripts").get_obj(), "assetallocationsend").get_obj(), "count").get_int64(), 1);
+    BOOST_CHECK_EQUAL(find_value(find_value(find_value(stages, "total").get_obj(), "assetallocationsend").get_obj(), "count").get_int64(), 1);
+    BOOST_CHECK_EQUAL(find_value(find_value(find_value(stages, "total").get_obj(), "plain").get_obj(), "count").get_int64(), 0);
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_asset_zdag_reorg_state)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_asset_zdag_reorg_state...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string guid = CreateZdagSender("node1", address, 100);
+    // one allocation send confirmed, one left in the mempool
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + CreateAllocationSend("node1", guid, address, 10) + "\""));
+    GenerateBlocks(1, "node1");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + CreateAllocationSend("node1", guid, address, 10) + "\""));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolinfo"));
+    const int64_t nMempoolSize = find_value(r.get_obj(), "size").get_int64();
+
+    // the ZDAG balances and arrival times follow the mempool through a reorg and back
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getbestblockhash"));
+    const string blockhash = r.get_str();
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "invalidateblock", "\"" + blockhash + "\"", false));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolreorginfo"));
+    const UniValue& zdag = find_value(r.get_obj(), "zdag").get_obj();
+    BOOST_CHECK(find_value(zdag, "consistent").get_bool());
+    BOOST_CHECK_EQUAL(find_value(zdag, "negativebalances").get_int64(), 0);
+    BOOST_CHECK_EQUAL(find_value(zdag, "stalearrivals").get_int64(), 0);
+    BOOST_CHECK(find_value(r.get_obj(), "resurrected").get_int64() >= 1);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolinfo"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "size").get_int64(), nMempoolSize + 1);
+
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "reconsiderblock", "\"" + blockhash + "\"", false));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolinfo"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "size").get_int64(), nMempoolSize);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolreorginfo"));
+    BOOST_CHECK(find_value(find_value(r.get_obj(), "zdag").get_obj(), "consistent").get_bool());
+    GenerateBlocks(1, "node1");
+}
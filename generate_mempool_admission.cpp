@@ -0,0 +1,863 @@
+// spend one confirmed output of node that no earlier call handed out, returned as a createrawtransaction input
+static string GetUnspentInput(const string& node, CAmount& nAmount)
+{
+    static std::set<string> setUsed;
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "listunspent", "1"));
+    const UniValue& unspents = r.get_array();
+    for (size_t i = 0; i < unspents.size(); i++) {
+        const UniValue& unspent = unspents[i].get_obj();
+        const string input = "{\"txid\":\"" + find_value(unspent, "txid").get_str() + "\",\"vout\":" + itostr(find_value(unspent, "vout").get_int()) + "}";
+        nAmount = AmountFromValue(find_value(unspent, "amount"));
+        if (nAmount < COIN || !find_value(unspent, "spendable").get_bool() || !setUsed.insert(input).second)
+            continue;
+        return input;
+    }
+    BOOST_ERROR("no unspent output left on " + node);
+    return "";
+}
+// create and sign a transaction spending inputs (a JSON array) to outputs (a JSON object),
+// prevtxs (a JSON array) describes inputs the wallet may not have seen yet
+static string CreateSignedTx(const string& node, const string& inputs, const string& outputs, bool replaceable = true, const string& prevtxs = "")
+{
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "createrawtransaction", inputs + "," + outputs + ",0," + (replaceable ? "true" : "false")));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "signrawtransactionwithwallet", "\"" + r.get_str() + "\"" + (prevtxs.empty() ? "" : "," + prevtxs)));
+    BOOST_CHECK(find_value(r.get_obj(), "complete").get_bool());
+    return find_value(r.get_obj(), "hex").get_str();
+}
+static string GetTxid(const string& node, const string& hex)
+{
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "decoderawtransaction", "\"" + hex + "\""));
+    return find_value(r.get_obj(), "txid").get_str();
+}
+static bool IsInMempool(const string& node, const string& txid)
+{
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "getrawmempool"));
+    const UniValue& mempool = r.get_array();
+    for (size_t i = 0; i < mempool.size(); i++) {
+        if (mempool[i].get_str() == txid)
+            return true;
+    }
+    return false;
+}
+static string AmountToString(const CAmount& nAmount)
+{
+    return ValueFromAmount(nAmount).write();
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_batch_replaced_parent)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_batch_replaced_parent...\n");
+    GenerateBlocks(5, "node1");
+    // parent in the mempool, and a batch with its replacement followed by its child
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string parent = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 1000) + "}");
+    const string replacement = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 100) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + parent + "\""));
+    const string parentid = GetTxid("node1", parent);
+    const string child = CreateSignedTx("node1", "[{\"txid\":\"" + parentid + "\",\"vout\":0}]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 500) + "}");
+
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions", "[\"" + replacement + "\",\"" + child + "\"]"));
+    UniValue results = r.get_array();
+    BOOST_CHECK_EQUAL(results.size(), 2);
+    BOOST_CHECK(find_value(results[0].get_obj(), "allowed").get_bool());
+    // the coins of the replaced parent must not be served from the batch's view
+    BOOST_CHECK(!find_value(results[1].get_obj(), "allowed").get_bool());
+    BOOST_CHECK_EQUAL(find_value(results[1].get_obj(), "reject-reason").get_str(), "missing-inputs");
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", replacement)));
+    BOOST_CHECK(!IsInMempool("node1", parentid));
+    BOOST_CHECK(!IsInMempool("node1", GetTxid("node1", child)));
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_sendrawtransactions)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_sendrawtransactions...\n");
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string tx = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 1000) + "}");
+    const string txid = GetTxid("node1", tx);
+
+    // the same transaction twice in a batch, and again once it is in the mempool, is allowed like sendrawtransaction does
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions", "[\"" + tx + "\",\"" + tx + "\"]"));
+    UniValue results = r.get_array();
+    BOOST_CHECK_EQUAL(results.size(), 2);
+    for (size_t i = 0; i < results.size(); i++) {
+        BOOST_CHECK_EQUAL(find_value(results[i].get_obj(), "txid").get_str(), txid);
+        BOOST_CHECK(find_value(results[i].get_obj(), "allowed").get_bool());
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions", "[\"" + tx + "\"]"));
+    BOOST_CHECK(find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tx + "\""));
+
+    // a replacement reports what it replaced
+    const string replacement = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 100) + "}");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions", "[\"" + replacement + "\"]"));
+    const UniValue& result = r.get_array()[0].get_obj();
+    BOOST_CHECK(find_value(result, "allowed").get_bool());
+    const UniValue& replaced = find_value(result, "replaced").get_array();
+    BOOST_CHECK_EQUAL(replaced.size(), 1);
+    BOOST_CHECK_EQUAL(replaced[0].get_str(), txid);
+
+    // maxfeerate must be an amount
+    BOOST_CHECK_THROW(CallExtRPC("node1", "sendrawtransactions", "[\"" + replacement + "\"],true"), runtime_error);
+    BOOST_CHECK_THROW(CallExtRPC("node1", "sendrawtransactions", "[\"" + replacement + "\"],-1"), runtime_error);
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_batch_conflicts)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_batch_conflicts...\n");
+    // transactions spending the same output fall into the same admission partition, exactly one of them gets in
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    CAmount nAmount2;
+    const string input2 = GetUnspentInput("node1", nAmount2);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string tx1 = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 1000) + "}", false);
+    const string tx2 = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 100) + "}", false);
+    const string tx3 = CreateSignedTx("node1", "[" + input2 + "]", "{\"" + address + "\":" + AmountToString(nAmount2 - COIN / 1000) + "}", false);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions", "[\"" + tx1 + "\",\"" + tx2 + "\",\"" + tx3 + "\"]"));
+    UniValue results = r.get_array();
+    BOOST_CHECK_EQUAL(results.size(), 3);
+    BOOST_CHECK(find_value(results[0].get_obj(), "allowed").get_bool() != find_value(results[1].get_obj(), "allowed").get_bool());
+    BOOST_CHECK(find_value(results[2].get_obj(), "allowed").get_bool());
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", tx1)) != IsInMempool("node1", GetTxid("node1", tx2)));
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", tx3)));
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_tip_context)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_tip_context...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    // the height of mempool entries follows the tip across blocks
+    for (int i = 0; i < 3; i++) {
+        GenerateBlocks(i + 1, "node1");
+        // the tip context is published from the validation interface queue
+        BOOST_CHECK_NO_THROW(CallExtRPC("node1", "syncwithvalidationinterfacequeue", "", false));
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getblockcount"));
+        const int64_t nHeight = r.get_int64();
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendtoaddress", "\"" + address + "\",1"));
+        const string txid = r.get_str();
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolentry", "\"" + txid + "\""));
+        BOOST_CHECK_EQUAL(find_value(r.get_obj(), "height").get_int64(), nHeight);
+    }
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_state_flush_thread)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_state_flush_thread...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendtoaddress", "\"" + address + "\",1"));
+    // the first admission started the flush thread, so admission no longer flushes inline below the cache limit
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getstateflushinfo"));
+    BOOST_CHECK(find_value(r.get_obj(), "running").get_bool());
+    const int64_t nInlineFlushes = find_value(r.get_obj(), "inlineflushes").get_int64();
+    for (int i = 0; i < 5; i++) {
+        BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendtoaddress", "\"" + address + "\",1"));
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getstateflushinfo"));
+    BOOST_CHECK(find_value(r.get_obj(), "running").get_bool());
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "inlineflushes").get_int64(), nInlineFlushes);
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_policy_trim_percent)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_policy_trim_percent...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "setmempoolpolicy"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "mempooltrimpercent").get_int64(), 90);
+    BOOST_CHECK_THROW(CallExtRPC("node1", "setmempoolpolicy", "{\"mempooltrimpercent\":0}"), runtime_error);
+    BOOST_CHECK_THROW(CallExtRPC("node1", "setmempoolpolicy", "{\"mempooltrimpercent\":101}"), runtime_error);
+    // trimming exactly to the limit is allowed
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "setmempoolpolicy", "{\"mempooltrimpercent\":100}"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "mempooltrimpercent").get_int64(), 100);
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", "{\"mempooltrimpercent\":90}"));
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_expiry)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_expiry...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    const string tx = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 1000) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tx + "\""));
+    const string txid = GetTxid("node1", tx);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolentry", "\"" + txid + "\""));
+    const int64_t nTime = find_value(r.get_obj(), "time").get_int64();
+
+    // an entry admitted under the default expiry expires once the expiry is lowered
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", "{\"mempoolexpiry\":1}"));
+    SetSysMocktime(nTime + 30 * 60);
+    CAmount nAmount2;
+    const string input2 = GetUnspentInput("node1", nAmount2);
+    const string tx2 = CreateSignedTx("node1", "[" + input2 + "]", "{\"" + address + "\":" + AmountToString(nAmount2 - COIN / 1000) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tx2 + "\""));
+    BOOST_CHECK(IsInMempool("node1", txid));
+    SetSysMocktime(nTime + 2 * 60 * 60);
+    CAmount nAmount3;
+    const string input3 = GetUnspentInput("node1", nAmount3);
+    const string tx3 = CreateSignedTx("node1", "[" + input3 + "]", "{\"" + address + "\":" + AmountToString(nAmount3 - COIN / 1000) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tx3 + "\""));
+    BOOST_CHECK(!IsInMempool("node1", txid));
+    // entries that are not due yet stay
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", tx2)));
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", tx3)));
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", "{\"mempoolexpiry\":336}"));
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_admission_records)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_admission_records...\n");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "getadmissionrecords"));
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "tpstestsetenabled", "true"));
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "tpstestadd", i64tostr(GetTimeMicros())));
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string tx = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 1000) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tx + "\""));
+    const string txid = GetTxid("node1", tx);
+
+    // arrivals during a TPS test are recorded by the admission recorder, and
+    // draining it hands them on to tpstestinfo
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getadmissionrecords"));
+    const UniValue& records = find_value(r.get_obj(), "records").get_array();
+    bool fFound = false;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (find_value(records[i].get_obj(), "txid").get_str() == txid) {
+            fFound = true;
+            BOOST_CHECK_EQUAL(find_value(records[i].get_obj(), "outcome").get_str(), "accepted");
+        }
+    }
+    BOOST_CHECK(fFound);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "tpstestinfo"));
+    BOOST_CHECK(!find_value(r.get_obj(), "receivers").get_array().empty());
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "tpstestsetenabled", "false"));
+    GenerateBlocks(1, "node1");
+}
+
+// send a chain of nLength transactions, each spending the single output of the previous one, starting at input
+static std::vector<string> SendChain(const string& node, const string& input, CAmount nAmount, const string& address, int nLength)
+{
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallExtRPC(node, "getaddressinfo", "\"" + address + "\""));
+    const string scriptPubKey = find_value(r.get_obj(), "scriptPubKey").get_str();
+    std::vector<string> vTxids;
+    string txin = input;
+    string prevtxs;
+    for (int i = 0; i < nLength; i++) {
+        nAmount -= COIN / 1000;
+        const string tx = CreateSignedTx(node, "[" + txin + "]", "{\"" + address + "\":" + AmountToString(nAmount) + "}", true, prevtxs);
+        BOOST_CHECK_NO_THROW(CallExtRPC(node, "sendrawtransaction", "\"" + tx + "\""));
+        vTxids.push_back(GetTxid(node, tx));
+        txin = "{\"txid\":\"" + vTxids.back() + "\",\"vout\":0}";
+        prevtxs = "[{\"txid\":\"" + vTxids.back() + "\",\"vout\":0,\"scriptPubKey\":\"" + scriptPubKey + "\",\"amount\":" + AmountToString(nAmount) + "}]";
+    }
+    return vTxids;
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_ancestor_chains)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_ancestor_chains...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "setmempoolpolicy"));
+    const string policy = r.write();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+
+    // a long chain from one sender keeps exact ancestor and descendant counts
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", "{\"limitancestorcount\":200,\"limitdescendantcount\":200,\"limitancestorsize\":1000,\"limitdescendantsize\":1000}"));
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    const std::vector<string> vChain = SendChain("node1", input, nAmount, address, 150);
+    BOOST_CHECK_EQUAL(vChain.size(), 150);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolentry", "\"" + vChain.back() + "\""));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "ancestorcount").get_int64(), 150);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolentry", "\"" + vChain.front() + "\""));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "descendantcount").get_int64(), 150);
+
+    // replacing the root would evict more than the 100 transactions BIP125 allows
+    const string replacement = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 2) + "}");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + replacement + "\"]"));
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "too many potential replacements");
+    BOOST_CHECK_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + replacement + "\""), runtime_error);
+    BOOST_CHECK(IsInMempool("node1", vChain.front()));
+    BOOST_CHECK(IsInMempool("node1", vChain.back()));
+
+    // the limits still hold along a chain
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", "{\"limitancestorcount\":5,\"limitdescendantcount\":5}"));
+    CAmount nAmount2;
+    const string input2 = GetUnspentInput("node1", nAmount2);
+    const std::vector<string> vShortChain = SendChain("node1", input2, nAmount2, address, 5);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getaddressinfo", "\"" + address + "\""));
+    const string scriptPubKey = find_value(r.get_obj(), "scriptPubKey").get_str();
+    const CAmount nLastAmount = nAmount2 - 5 * (COIN / 1000);
+    const string tooLong = CreateSignedTx("node1", "[{\"txid\":\"" + vShortChain.back() + "\",\"vout\":0}]", "{\"" + address + "\":" + AmountToString(nLastAmount - COIN / 1000) + "}", true,
+        "[{\"txid\":\"" + vShortChain.back() + "\",\"vout\":0,\"scriptPubKey\":\"" + scriptPubKey + "\",\"amount\":" + AmountToString(nLastAmount) + "}]");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + tooLong + "\"]"));
+    BOOST_CHECK(!find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "too-long-mempool-chain");
+
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", policy));
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_policy_relay_fees)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_policy_relay_fees...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "setmempoolpolicy"));
+    const string policy = r.write();
+    // the relay fees of the policy are the ones the rest of the node sees
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", "{\"minrelaytxfee\":0.01,\"incrementalrelayfee\":0.02}"));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolinfo"));
+    BOOST_CHECK_EQUAL(AmountFromValue(find_value(r.get_obj(), "minrelaytxfee")), COIN / 100);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnetworkinfo"));
+    BOOST_CHECK_EQUAL(AmountFromValue(find_value(r.get_obj(), "relayfee")), COIN / 100);
+    BOOST_CHECK_EQUAL(AmountFromValue(find_value(r.get_obj(), "incrementalfee")), COIN / 50);
+
+    // and admission enforces them
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    const string tx = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - 1000) + "}");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + tx + "\"]"));
+    BOOST_CHECK(!find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", policy));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + tx + "\"]"));
+    BOOST_CHECK(find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_wide_transaction)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_wide_transaction...\n");
+    GenerateBlocks(10, "node1");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getaddressinfo", "\"" + address + "\""));
+    const string scriptPubKey = find_value(r.get_obj(), "scriptPubKey").get_str();
+    // a parent in the mempool
+    CAmount nParentAmount;
+    const string parentInput = GetUnspentInput("node1", nParentAmount);
+    nParentAmount -= COIN / 1000;
+    const string parent = CreateSignedTx("node1", "[" + parentInput + "]", "{\"" + address + "\":" + AmountToString(nParentAmount) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + parent + "\""));
+    const string parentid = GetTxid("node1", parent);
+
+    // a transaction spending it and many confirmed coins, whose scripts and coins are checked by both passes
+    string inputs = "{\"txid\":\"" + parentid + "\",\"vout\":0}";
+    CAmount nTotal = nParentAmount;
+    for (int i = 0; i < 20; i++) {
+        CAmount nAmount;
+        inputs += "," + GetUnspentInput("node1", nAmount);
+        nTotal += nAmount;
+    }
+    const string tx = CreateSignedTx("node1", "[" + inputs + "]", "{\"" + address + "\":" + AmountToString(nTotal - COIN / 100) + "}", true,
+        "[{\"txid\":\"" + parentid + "\",\"vout\":0,\"scriptPubKey\":\"" + scriptPubKey + "\",\"amount\":" + AmountToString(nParentAmount) + "}]");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tx + "\""));
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", tx)));
+    GenerateBlocks(1, "node1");
+    BOOST_CHECK(!IsInMempool("node1", GetTxid("node1", tx)));
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_script_check_threads)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_script_check_threads...\n");
+    GenerateBlocks(10, "node1");
+    StopNode("node3");
+    StartNode("node3", true, "-mempoolscriptthreads=2 -mempoolparallelinputs=8");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    string inputs;
+    CAmount nTotal = 0;
+    for (int i = 0; i < 16; i++) {
+        CAmount nAmount;
+        if (!inputs.empty())
+            inputs += ",";
+        inputs += GetUnspentInput("node1", nAmount);
+        nTotal += nAmount;
+    }
+    const string tx = CreateSignedTx("node1", "[" + inputs + "]", "{\"" + address + "\":" + AmountToString(nTotal - COIN / 100) + "}");
+    // the inputs of the wide transaction are verified by the threads the first admission started
+    BOOST_CHECK_NO_THROW(CallExtRPC("node3", "sendrawtransaction", "\"" + tx + "\""));
+    BOOST_CHECK(IsInMempool("node3", GetTxid("node3", tx)));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node3", "getmempoolacceptstats"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "scriptthreads").get_int(), 2);
+    // and a bad signature is still caught: flip a hex digit inside the signature of the last witness,
+    // which sits before the pubkey (33 bytes) and the lock time (4 bytes)
+    string badtx = tx;
+    const size_t nPos = badtx.size() - 96;
+    badtx[nPos] = badtx[nPos] == '0' ? '1' : '0';
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node3", "testmempoolaccept", "[\"" + badtx + "\"]"));
+    BOOST_CHECK(!find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+    GenerateBlocks(1, "node3");
+    StopNode("node3");
+    StartNode("node3");
+}
+
+BOOST_AUTO_TEST_CASE(generate_block_tx_lookup)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_block_tx_lookup...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    std::vector<string> vTxids;
+    std::vector<string> vHex;
+    for (int i = 0; i < 5; i++) {
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendtoaddress", "\"" + address + "\",1"));
+        vTxids.push_back(r.get_str());
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + vTxids.back() + "\""));
+        vHex.push_back(r.get_str());
+    }
+    GenerateBlocks(1, "node1");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getbestblockhash"));
+    const string blockhash = r.get_str();
+    // the first lookup walks the block up to the transaction, the second walks
+    // all of it and builds its offset table, the later ones seek to the transaction
+    for (int nPass = 0; nPass < 2; nPass++) {
+        for (size_t i = 0; i < vTxids.size(); i++) {
+            BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + vTxids[i] + "\",false,\"" + blockhash + "\""));
+            BOOST_CHECK_EQUAL(r.get_str(), vHex[i]);
+        }
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + vTxids.front() + "\",true,\"" + blockhash + "\""));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "blockhash").get_str(), blockhash);
+    BOOST_CHECK(find_value(r.get_obj(), "in_active_chain").get_bool());
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_tx_index)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_tx_index...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    const string tx = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 1000) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tx + "\""));
+    const string txid = GetTxid("node1", tx);
+    // mempool transactions are served by the index the first admission started
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + txid + "\""));
+    BOOST_CHECK_EQUAL(r.get_str(), tx);
+
+    // a replaced transaction leaves the index
+    const string replacement = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 100) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + replacement + "\""));
+    const string replacementid = GetTxid("node1", replacement);
+    BOOST_CHECK_THROW(CallExtRPC("node1", "getrawtransaction", "\"" + txid + "\""), runtime_error);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + replacementid + "\""));
+    BOOST_CHECK_EQUAL(r.get_str(), replacement);
+
+    // and so does a mined one, which without -txindex is only found through its block
+    GenerateBlocks(1, "node1");
+    BOOST_CHECK_THROW(CallExtRPC("node1", "getrawtransaction", "\"" + replacementid + "\""), runtime_error);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getbestblockhash"));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + replacementid + "\",false,\"" + r.get_str() + "\""));
+    BOOST_CHECK_EQUAL(r.get_str(), replacement);
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_recent_rejects)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_recent_rejects...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    // spends more than its input, which is invalid whatever the mempool holds
+    const string tx = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount + COIN) + "}");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrecentrejectsinfo"));
+    const int64_t nHits = find_value(r.get_obj(), "hits").get_int64();
+    const int64_t nInserts = find_value(r.get_obj(), "inserts").get_int64();
+    const int64_t nResets = find_value(r.get_obj(), "resets").get_int64();
+
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + tx + "\"]"));
+    BOOST_CHECK(!find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "bad-txns-in-belowout");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrecentrejectsinfo"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "inserts").get_int64(), nInserts + 1);
+
+    // resubmitting it is turned away by the filter
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + tx + "\"]"));
+    BOOST_CHECK(!find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "txn-recently-rejected");
+    BOOST_CHECK_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tx + "\""), runtime_error);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrecentrejectsinfo"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "hits").get_int64(), nHits + 2);
+
+    // a new tip clears the filter, so the transaction is looked at again
+    GenerateBlocks(1, "node1");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + tx + "\"]"));
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "bad-txns-in-belowout");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrecentrejectsinfo"));
+    BOOST_CHECK(find_value(r.get_obj(), "resets").get_int64() > nResets);
+
+    // rejects that depend on the mempool are not remembered
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "createrawtransaction", "[{\"txid\":\"" + string(64, '1') + "\",\"vout\":0}],{\"" + address + "\":1}"));
+    const string missing = r.get_str();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + missing + "\"]"));
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "missing-inputs");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + missing + "\"]"));
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "missing-inputs");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_accept_stats)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_accept_stats...\n");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "getmempoolacceptstats", "true"));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolacceptstats"));
+    BOOST_CHECK_EQUAL(find_value(find_value(find_value(find_value(r.get_obj(), "stages").get_obj(), "total").get_obj(), "plain").get_obj(), "count").get_int64(), 0);
+
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    const string tx = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 1000) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + tx + "\""));
+    const string badtx = CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount + COIN) + "}");
+    BOOST_CHECK_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + badtx + "\""), runtime_error);
+
+    // every stage of the accepted plain transaction is timed, and the reject by its reason
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolacceptstats", "true"));
+    const UniValue& stages = find_value(r.get_obj(), "stages").get_obj();
+    for (const string& stage : {"prechecks", "policyscripts", "consensusscripts", "finalize", "total"}) {
+        const UniValue& plain = find_value(find_value(stages, stage).get_obj(), "plain").get_obj();
+        BOOST_CHECK(find_value(plain, "count").get_int64() >= 1);
+        BOOST_CHECK(find_value(plain, "p50").get_int64() <= find_value(plain, "p99").get_int64());
+        BOOST_CHECK(find_value(plain, "p99").get_int64() <= find_value(plain, "max").get_int64());
+    }
+    BOOST_CHECK_EQUAL(find_value(find_value(find_value(stages, "finalize").get_obj(), "assetallocationsend").get_obj(), "count").get_int64(), 0);
+    const UniValue& reject = find_value(find_value(r.get_obj(), "rejects").get_obj(), "bad-txns-in-belowout");
+    BOOST_CHECK(reject.isObject());
+    BOOST_CHECK_EQUAL(find_value(reject.get_obj(), "count").get_int64(), 1);
+
+    // reading with reset cleared them
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolacceptstats"));
+    BOOST_CHECK_EQUAL(find_value(find_value(find_value(r.get_obj(), "rejects").get_obj(), "bad-txns-in-belowout").get_obj(), "count").get_int64(), 0);
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_prefetch_inputs)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_prefetch_inputs...\n");
+    GenerateBlocks(5, "node1");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getaddressinfo", "\"" + address + "\""));
+    const string scriptPubKey = find_value(r.get_obj(), "scriptPubKey").get_str();
+
+    // a missing input fails the transaction, and the coins prefetched with it stay spendable
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "createrawtransaction", "[" + input + ",{\"txid\":\"" + string(64, '2') + "\",\"vout\":0}],{\"" + address + "\":1}"));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + r.get_str() + "\"]"));
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "missing-inputs");
+
+    // a batch mixing confirmed inputs, an in-batch parent and a mempool parent
+    CAmount nParentAmount;
+    const string parentInput = GetUnspentInput("node1", nParentAmount);
+    nParentAmount -= COIN / 1000;
+    const string parent = CreateSignedTx("node1", "[" + parentInput + "]", "{\"" + address + "\":" + AmountToString(nParentAmount) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + parent + "\""));
+    const string parentid = GetTxid("node1", parent);
+    const string fromMempool = CreateSignedTx("node1", "[{\"txid\":\"" + parentid + "\",\"vout\":0}]", "{\"" + address + "\":" + AmountToString(nParentAmount - COIN / 1000) + "}", true,
+        "[{\"txid\":\"" + parentid + "\",\"vout\":0,\"scriptPubKey\":\"" + scriptPubKey + "\",\"amount\":" + AmountToString(nParentAmount) + "}]");
+    string inputs = input;
+    CAmount nTotal = nAmount;
+    for (int i = 0; i < 5; i++) {
+        CAmount nInputAmount;
+        inputs += "," + GetUnspentInput("node1", nInputAmount);
+        nTotal += nInputAmount;
+    }
+    nTotal -= COIN / 100;
+    const string confirmed = CreateSignedTx("node1", "[" + inputs + "]", "{\"" + address + "\":" + AmountToString(nTotal) + "}");
+    const string confirmedid = GetTxid("node1", confirmed);
+    const string fromBatch = CreateSignedTx("node1", "[{\"txid\":\"" + confirmedid + "\",\"vout\":0}]", "{\"" + address + "\":" + AmountToString(nTotal - COIN / 1000) + "}", true,
+        "[{\"txid\":\"" + confirmedid + "\",\"vout\":0,\"scriptPubKey\":\"" + scriptPubKey + "\",\"amount\":" + AmountToString(nTotal) + "}]");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions", "[\"" + confirmed + "\",\"" + fromBatch + "\",\"" + fromMempool + "\"]"));
+    const UniValue& results = r.get_array();
+    BOOST_CHECK_EQUAL(results.size(), 3);
+    for (size_t i = 0; i < results.size(); i++) {
+        BOOST_CHECK(find_value(results[i].get_obj(), "allowed").get_bool());
+    }
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", fromBatch)));
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", fromMempool)));
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_rbf_opt_out)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_rbf_opt_out...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    CAmount nAmount1, nAmount2, nAmount3, nAmount4;
+    const string input1 = GetUnspentInput("node1", nAmount1);
+    const string input2 = GetUnspentInput("node1", nAmount2);
+    const string input3 = GetUnspentInput("node1", nAmount3);
+    const string input4 = GetUnspentInput("node1", nAmount4);
+    // one replaceable and one final transaction, each with two inputs
+    const string optIn = CreateSignedTx("node1", "[" + input1 + "," + input2 + "]", "{\"" + address + "\":" + AmountToString(nAmount1 + nAmount2 - COIN / 1000) + "}");
+    const string optOut = CreateSignedTx("node1", "[" + input3 + "," + input4 + "]", "{\"" + address + "\":" + AmountToString(nAmount3 + nAmount4 - COIN / 1000) + "}", false);
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + optIn + "\""));
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + optOut + "\""));
+
+    // conflicting with the final one, through either or both inputs, is refused
+    const string both = CreateSignedTx("node1", "[" + input3 + "," + input4 + "]", "{\"" + address + "\":" + AmountToString(nAmount3 + nAmount4 - COIN / 10) + "}");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + both + "\"]"));
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "txn-mempool-conflict");
+    const string mixed = CreateSignedTx("node1", "[" + input1 + "," + input3 + "]", "{\"" + address + "\":" + AmountToString(nAmount1 + nAmount3 - COIN / 10) + "}");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + mixed + "\"]"));
+    BOOST_CHECK_EQUAL(find_value(r.get_array()[0].get_obj(), "reject-reason").get_str(), "txn-mempool-conflict");
+
+    // conflicting with the replaceable one through both of its inputs replaces it
+    const string replacement = CreateSignedTx("node1", "[" + input1 + "," + input2 + "]", "{\"" + address + "\":" + AmountToString(nAmount1 + nAmount2 - COIN / 10) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + replacement + "\""));
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", replacement)));
+    BOOST_CHECK(!IsInMempool("node1", GetTxid("node1", optIn)));
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", optOut)));
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_entry_recycling)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_entry_recycling...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getadmissionmemoryinfo"));
+    const int64_t nAllocs = find_value(r.get_obj(), "entryallocs").get_int64();
+    const int64_t nReuses = find_value(r.get_obj(), "entryreuses").get_int64();
+    // every admission builds an entry, and the storage of finished ones is handed out again
+    const int nTxs = 20;
+    for (int i = 0; i < nTxs; i++) {
+        BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendtoaddress", "\"" + address + "\",1"));
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getadmissionmemoryinfo"));
+    const int64_t nNewAllocs = find_value(r.get_obj(), "entryallocs").get_int64() - nAllocs;
+    const int64_t nNewReuses = find_value(r.get_obj(), "entryreuses").get_int64() - nReuses;
+    BOOST_CHECK(nNewAllocs + nNewReuses >= nTxs);
+    BOOST_CHECK(nNewReuses > 0);
+    BOOST_CHECK(find_value(r.get_obj(), "entrycachedbytes").get_int64() > 0);
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_test_accept_cache)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_test_accept_cache...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    std::vector<string> vTxs;
+    for (int i = 0; i < 3; i++) {
+        CAmount nAmount;
+        const string input = GetUnspentInput("node1", nAmount);
+        vTxs.push_back(CreateSignedTx("node1", "[" + input + "]", "{\"" + address + "\":" + AmountToString(nAmount - COIN / 1000) + "}"));
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolacceptstats"));
+    const UniValue testaccepts = find_value(r.get_obj(), "testaccepts");
+    const int64_t nInserts = find_value(testaccepts, "inserts").get_int64();
+    const int64_t nHits = find_value(testaccepts, "hits").get_int64();
+    const int64_t nStale = find_value(testaccepts, "stale").get_int64();
+
+    // a test accept followed by a submit, singly and in a batch, skips script verification on the submit
+    for (const string& tx : vTxs) {
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "testmempoolaccept", "[\"" + tx + "\"]"));
+        BOOST_CHECK(find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+    }
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + vTxs[0] + "\""));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions", "[\"" + vTxs[1] + "\"]"));
+    BOOST_CHECK(find_value(r.get_array()[0].get_obj(), "allowed").get_bool());
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolacceptstats"));
+    BOOST_CHECK_EQUAL(find_value(find_value(r.get_obj(), "testaccepts"), "inserts").get_int64(), nInserts + 3);
+    BOOST_CHECK_EQUAL(find_value(find_value(r.get_obj(), "testaccepts"), "hits").get_int64(), nHits + 2);
+
+    // a test accept made on an earlier tip is not trusted, the transaction is verified again
+    GenerateBlocks(1, "node1");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + vTxs[2] + "\""));
+    BOOST_CHECK(IsInMempool("node1", GetTxid("node1", vTxs[2])));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolacceptstats"));
+    BOOST_CHECK_EQUAL(find_value(find_value(r.get_obj(), "testaccepts"), "hits").get_int64(), nHits + 2);
+    BOOST_CHECK_EQUAL(find_value(find_value(r.get_obj(), "testaccepts"), "stale").get_int64(), nStale + 1);
+    GenerateBlocks(1, "node1");
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_batch_generations)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_batch_generations...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getaddressinfo", "\"" + address + "\""));
+    const string scriptPubKey = find_value(r.get_obj(), "scriptPubKey").get_str();
+    // a batch listing children before their parents is admitted generation by generation
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    std::vector<string> vChain;
+    string txin = input;
+    string prevtxs;
+    for (int i = 0; i < 3; i++) {
+        nAmount -= COIN / 1000;
+        vChain.push_back(CreateSignedTx("node1", "[" + txin + "]", "{\"" + address + "\":" + AmountToString(nAmount) + "}", true, prevtxs));
+        const string txid = GetTxid("node1", vChain.back());
+        txin = "{\"txid\":\"" + txid + "\",\"vout\":0}";
+        prevtxs = "[{\"txid\":\"" + txid + "\",\"vout\":0,\"scriptPubKey\":\"" + scriptPubKey + "\",\"amount\":" + AmountToString(nAmount) + "}]";
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions", "[\"" + vChain[2] + "\",\"" + vChain[1] + "\",\"" + vChain[0] + "\"]"));
+    const UniValue& results = r.get_array();
+    BOOST_CHECK_EQUAL(results.size(), 3);
+    for (size_t i = 0; i < results.size(); i++) {
+        BOOST_CHECK(find_value(results[i].get_obj(), "allowed").get_bool());
+    }
+    for (const string& tx : vChain) {
+        BOOST_CHECK(IsInMempool("node1", GetTxid("node1", tx)));
+    }
+
+    // the same chain comes back in one batch when its block is disconnected
+    GenerateBlocks(1, "node1");
+    BOOST_CHECK(!IsInMempool("node1", GetTxid("node1", vChain[0])));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolreorginfo"));
+    const int64_t nReorgs = find_value(r.get_obj(), "reorgs").get_int64();
+    const int64_t nResurrected = find_value(r.get_obj(), "resurrected").get_int64();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getbestblockhash"));
+    const string blockhash = r.get_str();
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "invalidateblock", "\"" + blockhash + "\"", false));
+    for (const string& tx : vChain) {
+        BOOST_CHECK(IsInMempool("node1", GetTxid("node1", tx)));
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolreorginfo"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "reorgs").get_int64(), nReorgs + 1);
+    BOOST_CHECK(find_value(r.get_obj(), "resurrected").get_int64() >= nResurrected + 3);
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "reconsiderblock", "\"" + blockhash + "\"", false));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getbestblockhash"));
+    BOOST_CHECK_EQUAL(r.get_str(), blockhash);
+    BOOST_CHECK(!IsInMempool("node1", GetTxid("node1", vChain[2])));
+}
+
+BOOST_AUTO_TEST_CASE(generate_block_tx_stream)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_block_tx_stream...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    const string address = r.get_str();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getbestblockhash"));
+    const string prevblockhash = r.get_str();
+    // a block with a wide witness transaction between plain ones
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendtoaddress", "\"" + address + "\",1"));
+    string inputs;
+    CAmount nTotal = 0;
+    for (int i = 0; i < 10; i++) {
+        CAmount nAmount;
+        if (!inputs.empty())
+            inputs += ",";
+        inputs += GetUnspentInput("node1", nAmount);
+        nTotal += nAmount;
+    }
+    const string wide = CreateSignedTx("node1", "[" + inputs + "]", "{\"" + address + "\":" + AmountToString(nTotal - COIN / 100) + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + wide + "\""));
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendtoaddress", "\"" + address + "\",1"));
+    const string lasttxid = r.get_str();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + lasttxid + "\""));
+    const string last = r.get_str();
+    GenerateBlocks(1, "node1");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getbestblockhash"));
+    const string blockhash = r.get_str();
+
+    // walking the block returns transactions with their witness, wherever they are in it
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + GetTxid("node1", wide) + "\",false,\"" + blockhash + "\""));
+    BOOST_CHECK_EQUAL(r.get_str(), wide);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + lasttxid + "\",false,\"" + blockhash + "\""));
+    BOOST_CHECK_EQUAL(r.get_str(), last);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getblock", "\"" + blockhash + "\""));
+    const string coinbaseid = find_value(r.get_obj(), "tx").get_array()[0].get_str();
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getrawtransaction", "\"" + coinbaseid + "\",true,\"" + blockhash + "\""));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "txid").get_str(), coinbaseid);
+    // a transaction of another block is not found, whether the walk or the offset table answers
+    BOOST_CHECK_THROW(CallExtRPC("node1", "getrawtransaction", "\"" + lasttxid + "\",false,\"" + prevblockhash + "\""), runtime_error);
+    BOOST_CHECK_THROW(CallExtRPC("node1", "getrawtransaction", "\"" + lasttxid + "\",false,\"" + prevblockhash + "\""), runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(generate_mempool_batch_sibling_limits)
+{
+    UniValue r;
+    tfm::format(std::cout,"Running generate_mempool_batch_sibling_limits...\n");
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "setmempoolpolicy"));
+    const string policy = r.write();
+    // a mempool parent with three outputs
+    std::vector<string> vAddresses, vScriptPubKeys;
+    string outputs;
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+        vAddresses.push_back(r.get_str());
+        BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getaddressinfo", "\"" + vAddresses.back() + "\""));
+        vScriptPubKeys.push_back(find_value(r.get_obj(), "scriptPubKey").get_str());
+        outputs += (outputs.empty() ? "\"" : ",\"") + vAddresses.back() + "\":1";
+    }
+    CAmount nAmount;
+    const string input = GetUnspentInput("node1", nAmount);
+    BOOST_CHECK(nAmount > 3 * COIN);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getnewaddress"));
+    outputs += ",\"" + r.get_str() + "\":" + AmountToString(nAmount - 3 * COIN - COIN / 1000);
+    const string parent = CreateSignedTx("node1", "[" + input + "]", "{" + outputs + "}");
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "sendrawtransaction", "\"" + parent + "\""));
+    const string parentid = GetTxid("node1", parent);
+
+    // three children in one round: each is within the descendant limit on its own, but once
+    // the first two are in, the parent is at the limit plus the carve-out and the third must fail
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", "{\"limitdescendantcount\":2}"));
+    string children;
+    for (int i = 0; i < 3; i++) {
+        const string child = CreateSignedTx("node1", "[{\"txid\":\"" + parentid + "\",\"vout\":" + itostr(i) + "}]", "{\"" + vAddresses[i] + "\":" + AmountToString(COIN - COIN / 1000) + "}", true,
+            "[{\"txid\":\"" + parentid + "\",\"vout\":" + itostr(i) + ",\"scriptPubKey\":\"" + vScriptPubKeys[i] + "\",\"amount\":1}]");
+        children += (children.empty() ? "\"" : ",\"") + child + "\"";
+    }
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "sendrawtransactions", "[" + children + "]"));
+    const UniValue& results = r.get_array();
+    BOOST_CHECK_EQUAL(results.size(), 3);
+    int nAllowed = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (find_value(results[i].get_obj(), "allowed").get_bool()) {
+            nAllowed++;
+        } else {
+            BOOST_CHECK_EQUAL(find_value(results[i].get_obj(), "reject-reason").get_str(), "too-long-mempool-chain");
+        }
+    }
+    BOOST_CHECK_EQUAL(nAllowed, 2);
+    BOOST_CHECK_NO_THROW(r = CallExtRPC("node1", "getmempoolentry", "\"" + parentid + "\""));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "descendantcount").get_int64(), 3);
+
+    BOOST_CHECK_NO_THROW(CallExtRPC("node1", "setmempoolpolicy", policy));
+    GenerateBlocks(1, "node1");
+}
@@ -0,0 +1,376 @@
+// Copyright (c) 2020 The Syscoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SYSCOIN_MEMPOOLACCEPT_H
+#define SYSCOIN_MEMPOOLACCEPT_H
+
+#include <amount.h>
+#include <policy/feerate.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CAssetAllocation;
+class CAssetAllocationTuple;
+class CBlockIndex;
+class CChainParams;
+class CRPCTable;
+class CTxMemPool;
+class TxValidationState;
+class UniValue;
+
+extern RecursiveMutex cs_main;
+
+/**
+ * Immutable snapshot of the chain tip state needed by mempool admission.
+ * A new one is published from CValidationInterface::UpdatedBlockTip on every
+ * tip change, so MemPoolAccept and CheckSyscoinInputs validate one invocation
+ * against one consistent view of the tip without looking at ::ChainActive().
+ */
+struct CMempoolTipContext
+{
+    uint256 m_hash;
+    int m_height;
+    int64_t m_median_time_past;
+    int64_t m_block_time;
+    int m_best_header_height;
+    // Script flags a block on top of the tip is validated with
+    unsigned int m_script_flags;
+    bool m_initial_block_download;
+};
+
+/** Publish the tip context for pindexNew */
+void UpdateMempoolTipContext(const CBlockIndex* pindexNew, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/**
+ * Start/stop publishing the tip context on tip changes. The first admission
+ * starts it; it stops on shutdown.
+ */
+void StartMempoolTipContextPublisher();
+void StopMempoolTipContextPublisher();
+/** Return the last published tip context; only a call before the publisher started needs cs_main */
+std::shared_ptr<const CMempoolTipContext> GetMempoolTipContext();
+// SYSCOIN
+/** Whether the active tip is at or before the bridge start block, read from the chain every time */
+bool IsTipBeforeBridgeStart();
+
+/**
+ * Mempool admission policy with every limit already parsed and converted to
+ * the unit it is compared in. Admission reads one immutable snapshot per
+ * MemPoolAccept; a new one is published by SetMempoolPolicy.
+ */
+struct MempoolPolicy
+{
+    size_t m_limit_ancestors;
+    size_t m_limit_ancestor_size;   //!< bytes
+    size_t m_limit_descendants;
+    size_t m_limit_descendant_size; //!< bytes
+    size_t m_max_mempool_size;      //!< bytes
+    std::chrono::seconds m_expiry;
+    /**
+     * Percentage of m_max_mempool_size a trim evicts down to once usage passes
+     * it. Lower values trim less often but push the rolling minimum fee higher.
+     */
+    unsigned int m_trim_percent;
+    CFeeRate m_min_relay_fee;
+    CFeeRate m_incremental_relay_fee;
+    // SYSCOIN asset allocations pay the minimum relay fee for this many times their size
+    unsigned int m_asset_allocation_fee_multiplier;
+
+    CAmount GetMinRelayFee(size_t package_size, bool IsAssetAllocation) const
+    {
+        return m_min_relay_fee.GetFee(IsAssetAllocation ? package_size * m_asset_allocation_fee_multiplier : package_size);
+    }
+    /** Return false and set strError if the limits are inconsistent */
+    bool IsValid(std::string& strError) const;
+};
+
+/** Build a policy from the command line / config file arguments */
+std::shared_ptr<MempoolPolicy> MakeMempoolPolicyFromArgs();
+/** Return the current policy, built from the arguments on first use */
+std::shared_ptr<const MempoolPolicy> GetMempoolPolicy();
+/**
+ * Publish a new policy; also sets ::minRelayTxFee and ::incrementalRelayFee.
+ * A changed expiry re-arms the expiry timers of every entry on the next admission.
+ */
+void SetMempoolPolicy(std::shared_ptr<const MempoolPolicy> policy) LOCKS_EXCLUDED(cs_main);
+
+/**
+ * (try to) add a batch of transactions to the memory pool. states[i] and
+ * results[i] are filled in for txns[i]; vAbsurdFee is either empty or holds
+ * the absurd fee limit of every transaction. If pvReplaced is given,
+ * (*pvReplaced)[i] receives the mempool transactions txns[i] replaced.
+ * pool.cs must not be held, see CAdmissionPartitions for the lock order.
+ */
+void AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txns, std::vector<TxValidationState>& states,
+                        std::vector<bool>& results, bool bypass_limits, const std::vector<CAmount>& vAbsurdFee, bool test_accept = false,
+                        std::vector<std::list<CTransactionRef>>* pvReplaced = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main) LOCKS_EXCLUDED(pool.cs);
+
+/**
+ * Stop the background services the first mempool admission started (the
+ * Start* functions below). To be called from Shutdown() before DumpMempool,
+ * while the chainstate is still there; init.cpp is not part of this tree.
+ */
+void StopMempoolAdmissionServices();
+
+/**
+ * Start/stop the threads verifying scripts of batched mempool admissions
+ * (-mempoolscriptthreads), and of single transactions with at least
+ * -mempoolparallelinputs inputs. The first admission starts them; they stop
+ * on shutdown.
+ */
+void StartMempoolScriptCheckThreads();
+void StopMempoolScriptCheckThreads();
+int GetMempoolScriptCheckThreadCount();
+
+/**
+ * Start/stop the lock-free index of the transactions of pool that serves the
+ * mempool lookups of GetTransaction without cs_main. The first admission to
+ * the node's mempool starts it, so it runs before LoadMempool adds anything;
+ * StopMempoolAdmissionServices stops it, and lookups use the mempool itself
+ * while it is not running. CTxMemPool::clear() fires no NotifyEntryRemoved:
+ * a hit briefly takes mempool.cs to compare sizes and rebuilds the index
+ * from the mempool if they differ, and ClearMempoolTxIndex() after a clear
+ * spares that rebuild.
+ */
+void StartMempoolTxIndex(CTxMemPool& pool);
+void StopMempoolTxIndex();
+void ClearMempoolTxIndex();
+
+/**
+ * Start/stop the thread flushing the chainstate on behalf of mempool admission.
+ * The first admission starts it; it stops on shutdown, or by itself once
+ * shutdown is requested.
+ */
+void StartStateFlushThread();
+void StopStateFlushThread();
+
+/** Counters of the state flush thread */
+struct StateFlushStats {
+    bool m_running{false};
+    uint64_t m_requests{0};
+    uint64_t m_flushes{0};
+    uint64_t m_inline_flushes{0};
+    int64_t m_last_micros{0};
+    int64_t m_max_micros{0};
+    int64_t m_total_micros{0};
+};
+StateFlushStats GetStateFlushStats();
+
+/** Counters of the recently rejected transaction filter in front of mempool admission */
+struct RecentRejectsStats {
+    uint64_t m_hits;
+    uint64_t m_misses;
+    uint64_t m_inserts;
+    uint64_t m_resets;
+};
+RecentRejectsStats GetRecentRejectsStats();
+
+/** Stages of MemPoolAccept whose latency is recorded */
+enum class MempoolAcceptStage {
+    PRECHECKS,
+    POLICY_SCRIPTS,
+    CONSENSUS_SCRIPTS, //!< including CheckSyscoinInputs
+    FINALIZE,
+    TOTAL,             //!< the whole of AcceptToMemoryPoolWithTime
+    COUNT
+};
+
+// SYSCOIN
+/** Transaction classes, by nVersion, the admission latency is broken down by */
+enum class MempoolTxClass {
+    PLAIN,
+    ASSET,
+    ALLOCATION_SEND,
+    BURN,
+    MINT,
+    COUNT
+};
+
+MempoolTxClass GetMempoolTxClass(int nVersion);
+std::string MempoolAcceptStageName(MempoolAcceptStage stage);
+std::string MempoolTxClassName(MempoolTxClass txclass);
+
+/** Summary of one latency histogram, in microseconds */
+struct MempoolLatencySummary {
+    uint64_t m_count{0};
+    uint64_t m_total_micros{0};
+    uint64_t m_max_micros{0};
+    uint64_t m_p50_micros{0};
+    uint64_t m_p90_micros{0};
+    uint64_t m_p99_micros{0};
+};
+
+struct MempoolAcceptStats {
+    MempoolLatencySummary m_stages[(int)MempoolAcceptStage::COUNT][(int)MempoolTxClass::COUNT];
+    /** Latency of the whole admission of rejected transactions, by reject reason */
+    std::map<std::string, MempoolLatencySummary> m_rejects;
+};
+
+MempoolAcceptStats GetMempoolAcceptStats();
+void ResetMempoolAcceptStats();
+
+/** Counters of the cache of script results of successful test accepts */
+struct TestAcceptCacheStats {
+    uint64_t m_inserts; //!< test accepts remembered
+    uint64_t m_hits;    //!< submits that skipped script verification
+    uint64_t m_stale;   //!< submits whose test accept was on another tip or expired
+};
+TestAcceptCacheStats GetTestAcceptCacheStats();
+
+/** Outcome of an admission recorded by the arrival recorder */
+enum class AdmissionOutcome : uint8_t {
+    ACCEPTED,
+    REJECTED,
+    MISSING_INPUTS,
+    NOT_PROCESSED, //!< turned away before validation, e.g. by the scheduler
+};
+
+struct AdmissionRecord {
+    uint256 m_txid;
+    /** Arrival time in wall clock microseconds, derived from a monotonic clock */
+    int64_t m_time_micros;
+    AdmissionOutcome m_outcome;
+};
+
+struct AdmissionRecorderStats {
+    uint64_t m_recorded;
+    uint64_t m_dropped;
+    int m_sample_rate;
+};
+
+/**
+ * Size the arrival recorder's ring buffers (-admissionrecordsize records for
+ * each admitting thread) and set the always-on sampling rate
+ * (-admissionsamplerate, record one in N admissions, 0 = only during a TPS
+ * test). A thread allocates its ring on its first record, so nothing is
+ * allocated while neither is on. The first admission starts it.
+ */
+void StartAdmissionRecorder();
+/**
+ * Move every recorded arrival into vRecords (appended, oldest first per
+ * thread). The arrivals of a running TPS test are also appended to
+ * vecTPSTestReceivedTimesMempool.
+ */
+void DrainAdmissionRecords(std::vector<AdmissionRecord>& vRecords);
+/**
+ * Append the arrivals of a running TPS test to vecTPSTestReceivedTimesMempool,
+ * keeping them for DrainAdmissionRecords. tpstestinfo calls this before it
+ * reads the vector.
+ */
+void CollectTPSTestArrivals();
+AdmissionRecorderStats GetAdmissionRecorderStats();
+
+// SYSCOIN
+struct ZdagRemovalStats {
+    uint64_t m_queued;     //!< double spends queued for removal
+    uint64_t m_overflowed; //!< of those, queued through the locked fallback because the queue was full
+    uint64_t m_pending;    //!< queued but not handed out yet
+    uint64_t m_processed;  //!< handed out for removal
+    uint64_t m_legacy;     //!< queued to vecToRemoveFromMempool before a consumer called PopDueZdagRemovals
+};
+/**
+ * Hand out, oldest first, the double spends detected against a tip whose
+ * median time past is at or before nMedianTimePast. Single consumer. Until
+ * the first call, double spends keep going to vecToRemoveFromMempool.
+ */
+void PopDueZdagRemovals(int64_t nMedianTimePast, std::vector<std::pair<uint256, int64_t>>& vDue);
+ZdagRemovalStats GetZdagRemovalStats();
+
+// SYSCOIN
+/**
+ * Return whether sender has a ZDAG double spend on record, either in the
+ * sharded table or in the assetAllocationConflicts set assetconsensus.cpp
+ * keeps, see assetallocation.cpp
+ */
+bool AssetAllocationHasConflict(const CAssetAllocationTuple& sender);
+/**
+ * The tuple ZDAG double spends of theAssetAllocation are recorded against, the
+ * one GetActorsFromAssetAllocationTx names with bJustSender set: the sender,
+ * or the receiver of a SYSCOIN_BURN_TO_ALLOCATION
+ */
+CAssetAllocationTuple GetAssetAllocationConflictActor(const CAssetAllocation& theAssetAllocation, int nVersion);
+/** Record the double spend of sender, detected against a tip with median time past nTime */
+void AddAssetAllocationConflict(const CAssetAllocationTuple& sender, int64_t nTime);
+/**
+ * Forget the double spends recorded at or before nCutoff, called from
+ * UpdatedBlockTip when a block replaces the tip. Returns the number dropped.
+ */
+size_t PruneAssetAllocationConflicts(int64_t nCutoff);
+size_t GetAssetAllocationConflictsSize();
+
+/** One input a sender spent twice in the mempool */
+struct ZdagDoubleSpendEvidence {
+    uint256 m_txid;             //!< the transaction double spending
+    uint256 m_conflicting_txid; //!< the mempool transaction it conflicts with
+    COutPoint m_prevout;        //!< the input both spend
+    int64_t m_time;             //!< arrival time of m_txid
+};
+
+struct ZdagEvidenceStats {
+    uint64_t m_senders;
+    uint64_t m_records;   //!< evidence records held
+    uint64_t m_bytes;     //!< memory charged against m_max_bytes
+    uint64_t m_max_bytes;
+    uint64_t m_evictions; //!< senders evicted to stay within m_max_bytes
+};
+
+/**
+ * Read the evidence store cap (-zdagevidencemaxsize, in MiB) and whether new
+ * evidence is published (-zmqpubassetallocationdoublespend). The first
+ * admission calls it.
+ */
+void StartZdagEvidenceStore();
+/** Keep the double spend evidence of sender, publishing the records not seen before */
+void AddAssetAllocationDoubleSpendEvidence(const CAssetAllocationTuple& sender, const std::vector<ZdagDoubleSpendEvidence>& vEvidence);
+/** Return false if there is no evidence against sender, otherwise fill vEvidence oldest first */
+bool GetAssetAllocationDoubleSpendEvidence(const CAssetAllocationTuple& sender, std::vector<ZdagDoubleSpendEvidence>& vEvidence);
+ZdagEvidenceStats GetZdagEvidenceStats();
+
+/** Cost of putting the transactions of disconnected blocks back into the mempool */
+struct MempoolReorgStats {
+    uint64_t m_reorgs{0};          //!< reorgs since startup, the rest is about the last one
+    uint64_t m_disconnected{0};    //!< transactions of the disconnected blocks
+    uint64_t m_resurrected{0};     //!< of those, back in the mempool
+    uint64_t m_dropped{0};         //!< of those, removed along with their descendants
+    int64_t m_resurrect_micros{0}; //!< admitting them again
+    int64_t m_update_micros{0};    //!< UpdateTransactionsFromBlock
+    int64_t m_remove_micros{0};    //!< removeForReorg
+    int64_t m_limit_micros{0};     //!< LimitMempoolSize
+    int64_t m_total_micros{0};
+    uint64_t m_peak_usage{0};      //!< highest mempool memory usage seen in between
+};
+MempoolReorgStats GetMempoolReorgStats();
+
+// SYSCOIN
+/** Consistency of the ZDAG mempool state with the mempool, see assetallocation.cpp */
+struct ZdagMempoolStateStats {
+    uint64_t m_balances;          //!< allocations with a mempool balance
+    uint64_t m_negative_balances; //!< of those, below zero
+    uint64_t m_arrivals;          //!< arrival times kept
+    uint64_t m_stale_arrivals;    //!< of those, of transactions no longer in the mempool
+};
+ZdagMempoolStateStats GetZdagMempoolStateStats(const CTxMemPool& pool);
+
+/** Memory held by mempool admission outside the mempool itself */
+struct AdmissionMemoryStats {
+    uint64_t m_entry_allocs;       //!< mempool entries allocated from the heap
+    uint64_t m_entry_reuses;       //!< mempool entries built in recycled storage
+    uint64_t m_entry_cached_bytes; //!< storage kept for reuse by admitting threads
+    uint64_t m_recorder_bytes;     //!< ring buffers of the arrival recorder
+};
+AdmissionMemoryStats GetAdmissionMemoryStats();
+/** Admission memory usage, as reported by getadmissionmemoryinfo and getmempoolinfo (defined in mempoolrpc.cpp) */
+UniValue AdmissionMemoryInfoToJSON();
+/** Register the RPC commands of mempoolrpc.cpp, from RegisterAllCoreRPCCommands */
+void RegisterMempoolRPCCommands(CRPCTable& t);
+
+#endif // SYSCOIN_MEMPOOLACCEPT_H
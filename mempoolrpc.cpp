@@ -0,0 +1,659 @@
+// Copyright (c) 2020 The Syscoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <consensus/validation.h>
+#include <core_io.h>
+#include <mempoolaccept.h>
+#include <net.h>
+#include <net_processing.h>
+#include <node/context.h>
+#include <policy/policy.h>
+#include <primitives/transaction.h>
+#include <rpc/server.h>
+#include <rpc/util.h>
+#include <services/assetallocation.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <univalue.h>
+
+#include <limits>
+#include <map>
+
+namespace {
+
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"sendrawtransactions",
+                "\nSubmit a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+                "\nThe whole batch is accepted to the mempool in one go, which is much cheaper than\n"
+                "calling sendrawtransaction for every transaction. Transactions may spend outputs\n"
+                "of other transactions in the same batch. Like sendrawtransaction, a transaction\n"
+                "already in the mempool is relayed again and reported as allowed.\n"
+                "\nAlso see createrawtransaction and signrawtransactionwithkey calls.\n",
+                {
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions.",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                    {"maxfeerate", RPCArg::Type::AMOUNT, /* default */ FormatMoney(DEFAULT_MAX_RAW_TX_FEE_RATE.GetFeePerK()),
+                        "Reject transactions whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT + "/kB\n"},
+                },
+                RPCResult{
+            "[                   (json array) The result of the mempool acceptance test for each raw transaction in the input array.\n"
+            "  {\n"
+            "    \"txid\"           (string) The transaction hash in hex\n"
+            "    \"allowed\"        (boolean) If the transaction was accepted to the mempool and relayed\n"
+            "    \"reject-reason\"  (string) Rejection string (only present when 'allowed' is false)\n"
+            "    \"replaced\": [    (json array) The mempool transactions it replaced (only present when 'allowed' is true)\n"
+            "      \"txid\"         (string) The transaction hash in hex\n"
+            "      ,...\n"
+            "    ]\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+                },
+                RPCExamples{
+            "\nCreate a transaction\n"
+            + HelpExampleCli("createrawtransaction", "\"[{\\\"txid\\\" : \\\"mytxid\\\",\\\"vout\\\":0}]\" \"{\\\"myaddress\\\":0.01}\"") +
+            "Sign the transaction, and get back the hex\n"
+            + HelpExampleCli("signrawtransactionwithwallet", "\"myhex\"") +
+            "\nSend the transactions (signed hex)\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\"]\"") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\"]")
+                },
+            }.Check(request);
+
+    RPCTypeCheck(request.params, {
+        UniValue::VARR,
+        UniValueType(), // NUM or STR, checked by AmountFromValue
+    });
+
+    if (!g_rpc_node->connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    const UniValue& rawtxs = request.params[0].get_array();
+    const CFeeRate max_raw_tx_fee_rate = request.params[1].isNull() ?
+                                             DEFAULT_MAX_RAW_TX_FEE_RATE :
+                                             CFeeRate(AmountFromValue(request.params[1]));
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vAbsurdFee;
+    vtx.reserve(rawtxs.size());
+    vAbsurdFee.reserve(rawtxs.size());
+    for (unsigned int i = 0; i < rawtxs.size(); i++) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtxs[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        }
+        CTransactionRef tx(MakeTransactionRef(std::move(mtx)));
+        vAbsurdFee.push_back(max_raw_tx_fee_rate.GetFee(GetVirtualTransactionSize(*tx)));
+        vtx.push_back(std::move(tx));
+    }
+
+    // Only submit the first copy of every transaction not in the mempool yet;
+    // vSubmitted[i] is the index of the submitted copy of vtx[i], if any.
+    const size_t NOT_SUBMITTED = std::numeric_limits<size_t>::max();
+    std::vector<CTransactionRef> vtxSubmit;
+    std::vector<CAmount> vAbsurdFeeSubmit;
+    std::vector<size_t> vSubmitted(vtx.size(), NOT_SUBMITTED);
+    std::vector<TxValidationState> vState;
+    std::vector<bool> vAccepted;
+    std::vector<std::list<CTransactionRef>> vReplaced;
+    {
+        LOCK(cs_main);
+        std::map<uint256, size_t> mapSubmitted;
+        for (size_t i = 0; i < vtx.size(); i++) {
+            const uint256& txid = vtx[i]->GetHash();
+            auto it = mapSubmitted.find(txid);
+            if (it != mapSubmitted.end()) {
+                vSubmitted[i] = it->second;
+            } else if (!mempool.exists(txid)) {
+                vSubmitted[i] = vtxSubmit.size();
+                mapSubmitted.emplace(txid, vtxSubmit.size());
+                vtxSubmit.push_back(vtx[i]);
+                vAbsurdFeeSubmit.push_back(vAbsurdFee[i]);
+            }
+        }
+        AcceptToMemoryPoolBatch(mempool, vtxSubmit, vState, vAccepted, false /* bypass_limits */, vAbsurdFeeSubmit, false /* test_accept */, &vReplaced);
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        UniValue result_0(UniValue::VOBJ);
+        result_0.pushKV("txid", vtx[i]->GetHash().GetHex());
+        const size_t n = vSubmitted[i];
+        const bool fAllowed = n == NOT_SUBMITTED || vAccepted[n];
+        result_0.pushKV("allowed", fAllowed);
+        if (fAllowed) {
+            UniValue replaced(UniValue::VARR);
+            if (n != NOT_SUBMITTED) {
+                for (const CTransactionRef& txReplaced : vReplaced[n]) {
+                    replaced.push_back(txReplaced->GetHash().GetHex());
+                }
+            }
+            result_0.pushKV("replaced", replaced);
+            RelayTransaction(vtx[i]->GetHash(), *g_rpc_node->connman);
+        } else if (vState[n].GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
+            result_0.pushKV("reject-reason", "missing-inputs");
+        } else {
+            result_0.pushKV("reject-reason", vState[n].GetRejectReason());
+        }
+        result.push_back(result_0);
+    }
+    return result;
+}
+
+UniValue getrecentrejectsinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getrecentrejectsinfo",
+                "\nReturns the counters of the filter of recently rejected transactions, which turns\n"
+                "away resubmitted invalid transactions before any of their inputs are looked up.\n"
+                "The filter is cleared whenever the chain tip changes.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"hits\": xxxxx,     (numeric) Transactions rejected by the filter\n"
+            "  \"misses\": xxxxx,   (numeric) Transactions that passed the filter\n"
+            "  \"inserts\": xxxxx,  (numeric) Rejected transactions added to the filter\n"
+            "  \"resets\": xxxxx    (numeric) Times the filter was cleared on a tip change\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getrecentrejectsinfo", "")
+            + HelpExampleRpc("getrecentrejectsinfo", "")
+                },
+            }.Check(request);
+
+    const RecentRejectsStats stats = GetRecentRejectsStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("hits", stats.m_hits);
+    ret.pushKV("misses", stats.m_misses);
+    ret.pushKV("inserts", stats.m_inserts);
+    ret.pushKV("resets", stats.m_resets);
+    return ret;
+}
+
+UniValue getstateflushinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getstateflushinfo",
+                "\nReturns the counters of the thread flushing the chainstate on behalf of mempool admission.\n"
+                "All times are in microseconds.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"running\": true|false,  (boolean) Whether the flush thread is running\n"
+            "  \"requests\": xxxxx,      (numeric) Flushes requested by admission past the watermark\n"
+            "  \"flushes\": xxxxx,       (numeric) Flushes run by the thread\n"
+            "  \"inlineflushes\": xxxxx, (numeric) Flushes admission had to run itself\n"
+            "  \"last\": xxxxx,          (numeric) Duration of the last flush\n"
+            "  \"max\": xxxxx,           (numeric) Duration of the longest flush\n"
+            "  \"total\": xxxxx          (numeric) Duration of all flushes\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getstateflushinfo", "")
+            + HelpExampleRpc("getstateflushinfo", "")
+                },
+            }.Check(request);
+
+    const StateFlushStats stats = GetStateFlushStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("running", stats.m_running);
+    ret.pushKV("requests", stats.m_requests);
+    ret.pushKV("flushes", stats.m_flushes);
+    ret.pushKV("inlineflushes", stats.m_inline_flushes);
+    ret.pushKV("last", stats.m_last_micros);
+    ret.pushKV("max", stats.m_max_micros);
+    ret.pushKV("total", stats.m_total_micros);
+    return ret;
+}
+
+UniValue LatencySummaryToUniv(const MempoolLatencySummary& summary)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("count", summary.m_count);
+    ret.pushKV("avg", summary.m_count ? summary.m_total_micros / summary.m_count : 0);
+    ret.pushKV("p50", summary.m_p50_micros);
+    ret.pushKV("p90", summary.m_p90_micros);
+    ret.pushKV("p99", summary.m_p99_micros);
+    ret.pushKV("max", summary.m_max_micros);
+    return ret;
+}
+
+UniValue getmempoolacceptstats(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getmempoolacceptstats",
+                "\nReturns latency histograms of mempool admission, per stage and transaction type,\n"
+                "and of rejected admissions per reject reason. All times are in microseconds.\n",
+                {
+                    {"reset", RPCArg::Type::BOOL, /* default */ "false", "Clear the histograms after reading them"},
+                },
+                RPCResult{
+            "{\n"
+            "  \"stages\": {                   (json object) One entry per stage: prechecks, policyscripts,\n"
+            "                                 consensusscripts (including CheckSyscoinInputs), finalize and total\n"
+            "    \"stage\": {                  (json object) One entry per transaction type: plain, asset,\n"
+            "                                 assetallocationsend, burn and mint\n"
+            "      \"type\": {\n"
+            "        \"count\": n,             (numeric) Number of samples\n"
+            "        \"avg\": n,               (numeric) Average latency\n"
+            "        \"p50\": n,               (numeric) Median latency\n"
+            "        \"p90\": n,               (numeric) 90th percentile latency\n"
+            "        \"p99\": n,               (numeric) 99th percentile latency\n"
+            "        \"max\": n                (numeric) Maximum latency\n"
+            "      }, ...\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"rejects\": {                  (json object) Latency of rejected admissions, same fields as above\n"
+            "    \"reason\": { ... }, ...\n"
+            "  },\n"
+            "  \"scriptthreads\": n,           (numeric) Threads verifying scripts for admission (-mempoolscriptthreads)\n"
+            "  \"testaccepts\": {              (json object) Script results of test accepts reused on submit\n"
+            "    \"inserts\": n,               (numeric) Successful test accepts remembered\n"
+            "    \"hits\": n,                  (numeric) Submits that skipped script verification\n"
+            "    \"stale\": n                  (numeric) Submits whose test accept was on another tip or expired\n"
+            "  }\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getmempoolacceptstats", "")
+            + HelpExampleCli("getmempoolacceptstats", "true")
+            + HelpExampleRpc("getmempoolacceptstats", "")
+                },
+            }.Check(request);
+
+    const bool fReset = request.params[0].isNull() ? false : request.params[0].get_bool();
+    const MempoolAcceptStats stats = GetMempoolAcceptStats();
+    if (fReset) ResetMempoolAcceptStats();
+
+    UniValue stages(UniValue::VOBJ);
+    for (int stage = 0; stage < (int)MempoolAcceptStage::COUNT; stage++) {
+        UniValue types(UniValue::VOBJ);
+        for (int txclass = 0; txclass < (int)MempoolTxClass::COUNT; txclass++) {
+            types.pushKV(MempoolTxClassName((MempoolTxClass)txclass), LatencySummaryToUniv(stats.m_stages[stage][txclass]));
+        }
+        stages.pushKV(MempoolAcceptStageName((MempoolAcceptStage)stage), types);
+    }
+    UniValue rejects(UniValue::VOBJ);
+    for (const auto& reason : stats.m_rejects) {
+        rejects.pushKV(reason.first, LatencySummaryToUniv(reason.second));
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("stages", stages);
+    ret.pushKV("rejects", rejects);
+    ret.pushKV("scriptthreads", GetMempoolScriptCheckThreadCount());
+    const TestAcceptCacheStats testaccept_stats = GetTestAcceptCacheStats();
+    UniValue testaccepts(UniValue::VOBJ);
+    testaccepts.pushKV("inserts", testaccept_stats.m_inserts);
+    testaccepts.pushKV("hits", testaccept_stats.m_hits);
+    testaccepts.pushKV("stale", testaccept_stats.m_stale);
+    ret.pushKV("testaccepts", testaccepts);
+    return ret;
+}
+
+std::string AdmissionOutcomeName(AdmissionOutcome outcome)
+{
+    switch (outcome) {
+    case AdmissionOutcome::ACCEPTED: return "accepted";
+    case AdmissionOutcome::REJECTED: return "rejected";
+    case AdmissionOutcome::MISSING_INPUTS: return "missing-inputs";
+    case AdmissionOutcome::NOT_PROCESSED: return "not-processed";
+    }
+    assert(false);
+}
+
+UniValue getadmissionrecords(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getadmissionrecords",
+                "\nReturns and clears the transaction arrivals buffered by the mempool admission recorder,\n"
+                "which records every admission during a TPS test and one in -admissionsamplerate\n"
+                "admissions otherwise.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"recorded\": n,          (numeric) Arrivals recorded since startup\n"
+            "  \"dropped\": n,           (numeric) Arrivals dropped because a buffer was full\n"
+            "  \"samplerate\": n,        (numeric) One in this many admissions is recorded outside a TPS test\n"
+            "  \"records\": [\n"
+            "    {\n"
+            "      \"txid\": \"hash\",     (string) The transaction hash in hex\n"
+            "      \"time\": n,          (numeric) Arrival time in microseconds since epoch\n"
+            "      \"outcome\": \"str\"    (string) accepted, rejected, missing-inputs or not-processed\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getadmissionrecords", "")
+            + HelpExampleRpc("getadmissionrecords", "")
+                },
+            }.Check(request);
+
+    std::vector<AdmissionRecord> vRecords;
+    DrainAdmissionRecords(vRecords);
+    const AdmissionRecorderStats stats = GetAdmissionRecorderStats();
+
+    UniValue records(UniValue::VARR);
+    for (const AdmissionRecord& record : vRecords) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("txid", record.m_txid.GetHex());
+        obj.pushKV("time", record.m_time_micros);
+        obj.pushKV("outcome", AdmissionOutcomeName(record.m_outcome));
+        records.push_back(obj);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("recorded", stats.m_recorded);
+    ret.pushKV("dropped", stats.m_dropped);
+    ret.pushKV("samplerate", stats.m_sample_rate);
+    ret.pushKV("records", records);
+    return ret;
+}
+
+UniValue MempoolPolicyToUniv(const MempoolPolicy& policy)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("limitancestorcount", (uint64_t)policy.m_limit_ancestors);
+    ret.pushKV("limitancestorsize", (uint64_t)policy.m_limit_ancestor_size / 1000);
+    ret.pushKV("limitdescendantcount", (uint64_t)policy.m_limit_descendants);
+    ret.pushKV("limitdescendantsize", (uint64_t)policy.m_limit_descendant_size / 1000);
+    ret.pushKV("maxmempool", (uint64_t)policy.m_max_mempool_size / 1000000);
+    ret.pushKV("mempoolexpiry", (int64_t)std::chrono::duration_cast<std::chrono::hours>(policy.m_expiry).count());
+    ret.pushKV("mempooltrimpercent", (uint64_t)policy.m_trim_percent);
+    ret.pushKV("minrelaytxfee", ValueFromAmount(policy.m_min_relay_fee.GetFeePerK()));
+    ret.pushKV("incrementalrelayfee", ValueFromAmount(policy.m_incremental_relay_fee.GetFeePerK()));
+    ret.pushKV("assetallocationfeemultiplier", (uint64_t)policy.m_asset_allocation_fee_multiplier);
+    return ret;
+}
+
+UniValue setmempoolpolicy(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"setmempoolpolicy",
+                "\nChanges the mempool admission policy of a running node. Fields that are not given keep\n"
+                "their current value. Transactions already in the mempool are not re-evaluated, and the\n"
+                "change is lost on restart. Returns the policy in effect afterwards.\n",
+                {
+                    {"policy", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED_NAMED_ARG, "",
+                        {
+                            {"limitancestorcount", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "Maximum number of in-mempool ancestors"},
+                            {"limitancestorsize", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "Maximum size of a transaction with its in-mempool ancestors, in kB"},
+                            {"limitdescendantcount", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "Maximum number of in-mempool descendants"},
+                            {"limitdescendantsize", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "Maximum size of a transaction with its in-mempool descendants, in kB"},
+                            {"maxmempool", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "Maximum mempool size, in MB"},
+                            {"mempoolexpiry", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "Hours transactions are kept in the mempool"},
+                            {"mempooltrimpercent", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "Percentage of maxmempool a full mempool is trimmed down to (1-100). Lower values raise the rolling minimum fee further"},
+                            {"minrelaytxfee", RPCArg::Type::AMOUNT, RPCArg::Optional::OMITTED, "Minimum relay fee rate, in " + CURRENCY_UNIT + "/kB"},
+                            {"incrementalrelayfee", RPCArg::Type::AMOUNT, RPCArg::Optional::OMITTED, "Fee rate a replacement has to add, in " + CURRENCY_UNIT + "/kB"},
+                            {"assetallocationfeemultiplier", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "Asset allocations pay the minimum relay fee for this many times their size"},
+                        },
+                        "policy"},
+                },
+                RPCResult{
+            "{                                  (json object) The policy in effect, with the fields above\n"
+            "  ...\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("setmempoolpolicy", "\"{\\\"maxmempool\\\":600}\"")
+            + HelpExampleRpc("setmempoolpolicy", "{\"maxmempool\":600}")
+                },
+            }.Check(request);
+
+    std::shared_ptr<MempoolPolicy> policy = std::make_shared<MempoolPolicy>(*GetMempoolPolicy());
+    if (request.params[0].isNull()) {
+        return MempoolPolicyToUniv(*policy);
+    }
+    const UniValue& options = request.params[0].get_obj();
+    RPCTypeCheckObj(options,
+        {
+            {"limitancestorcount", UniValueType(UniValue::VNUM)},
+            {"limitancestorsize", UniValueType(UniValue::VNUM)},
+            {"limitdescendantcount", UniValueType(UniValue::VNUM)},
+            {"limitdescendantsize", UniValueType(UniValue::VNUM)},
+            {"maxmempool", UniValueType(UniValue::VNUM)},
+            {"mempoolexpiry", UniValueType(UniValue::VNUM)},
+            {"mempooltrimpercent", UniValueType(UniValue::VNUM)},
+            {"minrelaytxfee", UniValueType()}, // will be checked below
+            {"incrementalrelayfee", UniValueType()}, // will be checked below
+            {"assetallocationfeemultiplier", UniValueType(UniValue::VNUM)},
+        },
+        true, true);
+
+    auto GetPositive = [&](const std::string& strKey) {
+        const int64_t nValue = options[strKey].get_int64();
+        if (nValue <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s must be positive", strKey));
+        }
+        return nValue;
+    };
+    if (options.exists("limitancestorcount")) policy->m_limit_ancestors = GetPositive("limitancestorcount");
+    if (options.exists("limitancestorsize")) policy->m_limit_ancestor_size = GetPositive("limitancestorsize") * 1000;
+    if (options.exists("limitdescendantcount")) policy->m_limit_descendants = GetPositive("limitdescendantcount");
+    if (options.exists("limitdescendantsize")) policy->m_limit_descendant_size = GetPositive("limitdescendantsize") * 1000;
+    if (options.exists("maxmempool")) policy->m_max_mempool_size = GetPositive("maxmempool") * 1000000;
+    if (options.exists("mempoolexpiry")) policy->m_expiry = std::chrono::hours{GetPositive("mempoolexpiry")};
+    if (options.exists("mempooltrimpercent")) policy->m_trim_percent = GetPositive("mempooltrimpercent");
+    if (options.exists("minrelaytxfee")) policy->m_min_relay_fee = CFeeRate(AmountFromValue(options["minrelaytxfee"]));
+    if (options.exists("incrementalrelayfee")) policy->m_incremental_relay_fee = CFeeRate(AmountFromValue(options["incrementalrelayfee"]));
+    if (options.exists("assetallocationfeemultiplier")) policy->m_asset_allocation_fee_multiplier = GetPositive("assetallocationfeemultiplier");
+
+    std::string strError;
+    if (!policy->IsValid(strError)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strError);
+    }
+    SetMempoolPolicy(policy);
+    return MempoolPolicyToUniv(*policy);
+}
+
+UniValue getzdagremovalinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getzdagremovalinfo",
+                "\nReturns the counters of the queue of asset allocation double spends waiting to be\n"
+                "removed from the mempool.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"queued\": n,       (numeric) Double spends queued for removal since startup\n"
+            "  \"overflowed\": n,   (numeric) Of those, queued through the locked fallback because the queue was full\n"
+            "  \"pending\": n,      (numeric) Queued but not removed yet\n"
+            "  \"processed\": n,    (numeric) Handed out for removal\n"
+            "  \"legacy\": n,       (numeric) Handed straight to the removal loop because nothing polls the queue yet\n"
+            "  \"conflicts\": n     (numeric) Senders with a double spend on record\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getzdagremovalinfo", "")
+            + HelpExampleRpc("getzdagremovalinfo", "")
+                },
+            }.Check(request);
+
+    const ZdagRemovalStats stats = GetZdagRemovalStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("queued", stats.m_queued);
+    ret.pushKV("overflowed", stats.m_overflowed);
+    ret.pushKV("pending", stats.m_pending);
+    ret.pushKV("processed", stats.m_processed);
+    ret.pushKV("legacy", stats.m_legacy);
+    ret.pushKV("conflicts", (uint64_t)GetAssetAllocationConflictsSize());
+    return ret;
+}
+
+UniValue getmempoolreorginfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getmempoolreorginfo",
+                "\nReturns what putting the transactions of the blocks disconnected by the last reorg back\n"
+                "into the mempool cost, and checks the ZDAG mempool state against the mempool.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"reorgs\": n,            (numeric) Reorgs since startup, the rest is about the last one\n"
+            "  \"disconnected\": n,      (numeric) Transactions of the disconnected blocks\n"
+            "  \"resurrected\": n,       (numeric) Of those, back in the mempool\n"
+            "  \"dropped\": n,           (numeric) Of those, removed along with their descendants\n"
+            "  \"peakusage\": n,         (numeric) Highest mempool memory usage seen while updating the mempool\n"
+            "  \"micros\": {             (json object) Time spent in every stage, in microseconds\n"
+            "    \"resurrect\": n,\n"
+            "    \"updatedescendants\": n,\n"
+            "    \"removeforreorg\": n,\n"
+            "    \"limit\": n,\n"
+            "    \"total\": n\n"
+            "  },\n"
+            "  \"zdag\": {               (json object) ZDAG mempool state, as of now\n"
+            "    \"balances\": n,        (numeric) Allocations with a mempool balance\n"
+            "    \"negativebalances\": n,(numeric) Of those, below zero\n"
+            "    \"arrivals\": n,        (numeric) Arrival times kept\n"
+            "    \"stalearrivals\": n,   (numeric) Of those, of transactions no longer in the mempool\n"
+            "    \"consistent\": true|false (boolean) If there are no negative balances and no stale arrival times\n"
+            "  }\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getmempoolreorginfo", "")
+            + HelpExampleRpc("getmempoolreorginfo", "")
+                },
+            }.Check(request);
+
+    const MempoolReorgStats stats = GetMempoolReorgStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("reorgs", stats.m_reorgs);
+    ret.pushKV("disconnected", stats.m_disconnected);
+    ret.pushKV("resurrected", stats.m_resurrected);
+    ret.pushKV("dropped", stats.m_dropped);
+    ret.pushKV("peakusage", stats.m_peak_usage);
+    UniValue micros(UniValue::VOBJ);
+    micros.pushKV("resurrect", stats.m_resurrect_micros);
+    micros.pushKV("updatedescendants", stats.m_update_micros);
+    micros.pushKV("removeforreorg", stats.m_remove_micros);
+    micros.pushKV("limit", stats.m_limit_micros);
+    micros.pushKV("total", stats.m_total_micros);
+    ret.pushKV("micros", micros);
+
+    const ZdagMempoolStateStats zdag = GetZdagMempoolStateStats(mempool);
+    UniValue zdagObj(UniValue::VOBJ);
+    zdagObj.pushKV("balances", zdag.m_balances);
+    zdagObj.pushKV("negativebalances", zdag.m_negative_balances);
+    zdagObj.pushKV("arrivals", zdag.m_arrivals);
+    zdagObj.pushKV("stalearrivals", zdag.m_stale_arrivals);
+    zdagObj.pushKV("consistent", zdag.m_negative_balances == 0 && zdag.m_stale_arrivals == 0);
+    ret.pushKV("zdag", zdagObj);
+    return ret;
+}
+
+// SYSCOIN
+UniValue assetallocationdoublespends(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"assetallocationdoublespends",
+                "\nReturns the ZDAG double spend evidence kept against the sender of an asset allocation,\n"
+                "oldest first. The store keeps the last 16 double spent inputs of every sender.\n",
+                {
+                    {"asset_guid", RPCArg::Type::NUM, RPCArg::Optional::NO, "The asset guid."},
+                    {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The address of the sender."},
+                },
+                RPCResult{
+            "{\n"
+            "  \"evidence\": [           (json array) Empty if the sender has no double spend on record\n"
+            "    {\n"
+            "      \"txid\": \"hex\",             (string) The transaction double spending\n"
+            "      \"conflicting_txid\": \"hex\", (string) The mempool transaction it conflicts with\n"
+            "      \"prevout_txid\": \"hex\",     (string) The input both spend\n"
+            "      \"prevout_n\": n,              (numeric)\n"
+            "      \"time\": n                    (numeric) Arrival time of txid in seconds since epoch (Jan 1 1970 GMT)\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"senders\": n,          (numeric) Senders with evidence on record\n"
+            "  \"records\": n,          (numeric) Evidence records held\n"
+            "  \"bytes\": n,            (numeric) Memory used by the evidence store\n"
+            "  \"maxbytes\": n,         (numeric) Memory cap of the evidence store (-zdagevidencemaxsize)\n"
+            "  \"evictions\": n         (numeric) Senders evicted to stay within the memory cap\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("assetallocationdoublespends", "1045909988 \"sys1qw40fdue7g7r5ugw0epzk7xy24tywncm26hu4a7\"")
+            + HelpExampleRpc("assetallocationdoublespends", "1045909988, \"sys1qw40fdue7g7r5ugw0epzk7xy24tywncm26hu4a7\"")
+                },
+            }.Check(request);
+
+    const CAssetAllocationTuple sender(request.params[0].get_uint(), DescribeWitnessAddress(request.params[1].get_str()));
+    std::vector<ZdagDoubleSpendEvidence> vEvidence;
+    GetAssetAllocationDoubleSpendEvidence(sender, vEvidence);
+
+    UniValue evidence(UniValue::VARR);
+    for (const ZdagDoubleSpendEvidence& record : vEvidence) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", record.m_txid.GetHex());
+        entry.pushKV("conflicting_txid", record.m_conflicting_txid.GetHex());
+        entry.pushKV("prevout_txid", record.m_prevout.hash.GetHex());
+        entry.pushKV("prevout_n", (int)record.m_prevout.n);
+        entry.pushKV("time", record.m_time);
+        evidence.push_back(entry);
+    }
+    const ZdagEvidenceStats stats = GetZdagEvidenceStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("evidence", evidence);
+    ret.pushKV("senders", stats.m_senders);
+    ret.pushKV("records", stats.m_records);
+    ret.pushKV("bytes", stats.m_bytes);
+    ret.pushKV("maxbytes", stats.m_max_bytes);
+    ret.pushKV("evictions", stats.m_evictions);
+    return ret;
+}
+
+UniValue getadmissionmemoryinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getadmissionmemoryinfo",
+                "\nReturns the memory held by mempool admission outside the mempool itself.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"entryallocs\": n,       (numeric) Mempool entries allocated from the heap\n"
+            "  \"entryreuses\": n,       (numeric) Mempool entries built in storage recycled by their thread\n"
+            "  \"entrycachedbytes\": n,  (numeric) Entry storage kept for reuse by admitting threads\n"
+            "  \"recorderbytes\": n      (numeric) Ring buffers of the admission recorder\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getadmissionmemoryinfo", "")
+            + HelpExampleRpc("getadmissionmemoryinfo", "")
+                },
+            }.Check(request);
+
+    return AdmissionMemoryInfoToJSON();
+}
+
+const CRPCCommand commands[] =
+{ //  category              name                                actor (function)                argNames
+  //  -----------------     ------------------------            -----------------------         ----------
+    { "rawtransactions",    "sendrawtransactions",              &sendrawtransactions,           {"rawtxs","maxfeerate"} },
+    { "blockchain",         "getrecentrejectsinfo",             &getrecentrejectsinfo,          {} },
+    { "blockchain",         "getstateflushinfo",                &getstateflushinfo,             {} },
+    { "blockchain",         "getmempoolacceptstats",            &getmempoolacceptstats,         {"reset"} },
+    { "blockchain",         "getadmissionrecords",              &getadmissionrecords,           {} },
+    { "blockchain",         "getadmissionmemoryinfo",           &getadmissionmemoryinfo,        {} },
+    { "blockchain",         "setmempoolpolicy",                 &setmempoolpolicy,              {"policy"} },
+    { "blockchain",         "getzdagremovalinfo",               &getzdagremovalinfo,            {} },
+    { "blockchain",         "getmempoolreorginfo",              &getmempoolreorginfo,           {} },
+    { "syscoin",            "assetallocationdoublespends",      &assetallocationdoublespends,   {"asset_guid","address"} },
+};
+
+} // anonymous namespace
+
+UniValue AdmissionMemoryInfoToJSON()
+{
+    const AdmissionMemoryStats stats = GetAdmissionMemoryStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("entryallocs", stats.m_entry_allocs);
+    ret.pushKV("entryreuses", stats.m_entry_reuses);
+    ret.pushKV("entrycachedbytes", stats.m_entry_cached_bytes);
+    ret.pushKV("recorderbytes", stats.m_recorder_bytes);
+    return ret;
+}
+
+void RegisterMempoolRPCCommands(CRPCTable& t)
+{
+    for (const auto& c : commands) {
+        t.appendCommand(c.name, &c);
+    }
+}
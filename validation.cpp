@@ -14,152 +14,2355 @@ bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, Precompute
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
+    size_t nFailedIn;
+    if (!CheckInputScriptsRecorded(ws, state, scriptVerifyFlags, txdata, nFailedIn)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
         // to see if the failure is specifically due to witness validation.
-        TxValidationState state_dummy; // Want reported failures to be from first CheckInputScripts
-        if (!tx.HasWitness() && CheckInputScripts(tx, state_dummy, m_view, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
-                !CheckInputScripts(tx, state_dummy, m_view, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
+        // Every other input passed with the full flags, so only the failing
+        // one is verified again.
+        if (!tx.HasWitness() && nFailedIn < tx.vin.size() && CheckInputScriptRecorded(ws, nFailedIn, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), txdata) &&
+                !CheckInputScriptRecorded(ws, nFailedIn, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, txdata)) {
             // Only the witness is missing, so the transaction itself may be fine.
             state.Invalid(TxValidationResult::TX_WITNESS_MUTATED,
                     state.GetRejectReason(), state.GetDebugMessage());
         }
-        return false; // state filled in by CheckInputScripts
+        return false; // state filled in by CheckInputScriptsRecorded
     }
 
     return true;
 }
 
+// Record in the script execution cache that tx passed its scripts with
+// flags, as CheckInputScripts does with cacheFullScriptStore, so that block
+// connection does not verify it again.
+static void AddToScriptExecutionCache(const CTransaction& tx, unsigned int flags) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    uint256 hashCacheEntry;
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    scriptExecutionCache.insert(hashCacheEntry);
+}
+
+// The coin checks of CheckInputsFromMempoolAndCache without the script
+// checks: every input of tx must be available in view, and its coin there
+// must be the output of the mempool parent, or else the unspent coin of the
+// chainstate.
+static bool CheckInputCoinsFromMempoolAndCache(const CTransaction& tx, const CCoinsViewCache& view, const CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    assert(!tx.IsCoinBase());
+    for (const CTxIn& txin : tx.vin) {
+        const Coin& coin = view.AccessCoin(txin.prevout);
+        // PreChecks has already checked that the coins are available, so
+        // this shouldn't fail.
+        if (coin.IsSpent()) return false;
+
+        const CTransactionRef& txFrom = pool.get(txin.prevout.hash);
+        if (txFrom) {
+            assert(txFrom->GetHash() == txin.prevout.hash);
+            assert(txFrom->vout.size() > txin.prevout.n);
+            assert(txFrom->vout[txin.prevout.n] == coin.out);
+        } else {
+            const Coin& coinFromDisk = ::ChainstateActive().CoinsTip().AccessCoin(txin.prevout);
+            assert(!coinFromDisk.IsSpent());
+            assert(coinFromDisk.out == coin.out);
+        }
+    }
+    return true;
+}
+
+bool MemPoolAccept::CheckInputScriptRecorded(Workspace& ws, size_t nIn, unsigned int flags, PrecomputedTransactionData& txdata)
+{
+    const CTransaction& tx = *ws.m_ptx;
+    const Coin& coin = m_view.AccessCoin(tx.vin[nIn].prevout);
+    assert(!coin.IsSpent());
+    CScriptCheck check(coin.out, tx, nIn, flags, true /* cacheStore */, &txdata);
+    const bool fPassed = check();
+    ws.m_script_results.Set(nIn, flags, fPassed);
+    return fPassed;
+}
+
+bool MemPoolAccept::CheckInputScriptsRecorded(Workspace& ws, TxValidationState& state, unsigned int flags, PrecomputedTransactionData& txdata, size_t& nFailedIn)
+{
+    const CTransaction& tx = *ws.m_ptx;
+    CInputScriptResults& results = ws.m_script_results;
+    results.Init(tx.vin.size());
+    nFailedIn = tx.vin.size();
+    if (results.IsCovered(flags)) return true;
+
+    // Let CheckInputScripts look the transaction up in the script execution
+    // cache and build the per-input checks, then only run those of the
+    // inputs no earlier pass covers.
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputScripts(tx, state, m_view, flags, true, false, txdata, &vChecks)) return false;
+    if (vChecks.empty()) {
+        results.SetAllPassed(flags);
+        return true;
+    }
+    std::vector<size_t> vPending;
+    for (size_t i = 0; i < vChecks.size(); i++) {
+        if (!results.IsCovered(i, flags)) vPending.push_back(i);
+    }
+
+    size_t nFailed = vChecks.size();
+    ScriptError error = SCRIPT_ERR_UNKNOWN_ERROR;
+    const size_t nJobs = g_mempool_script_check_pool.GetInputJobCount(vPending.size());
+    if (nJobs > 1) {
+        // Spread the inputs of a big transaction over the script check
+        // threads, each job taking a contiguous run of the pending inputs,
+        // so its latency does not hold up the admissions behind it.
+        std::vector<CMempoolScriptCheckPool::Job> jobs(nJobs);
+        for (size_t n = 0; n < vPending.size(); n++) {
+            std::vector<CScriptCheck>& checks = jobs[n * nJobs / vPending.size()].m_checks;
+            checks.emplace_back();
+            checks.back().swap(vChecks[vPending[n]]);
+        }
+        g_mempool_script_check_pool.Run(jobs);
+        size_t nFirst = 0;
+        for (const CMempoolScriptCheckPool::Job& job : jobs) {
+            for (size_t k = 0; k < job.m_passed; k++) {
+                results.Set(vPending[nFirst + k], flags, true);
+            }
+            // report the first failing input, as the serial loop would
+            if (!job.m_result && nFailed == vChecks.size()) {
+                nFailed = vPending[nFirst + job.m_passed];
+                error = job.m_error;
+            }
+            nFirst += job.m_checks.size();
+        }
+    } else {
+        for (const size_t i : vPending) {
+            if (vChecks[i]()) {
+                results.Set(i, flags, true);
+                continue;
+            }
+            nFailed = i;
+            error = vChecks[i].GetScriptError();
+            break;
+        }
+    }
+    if (nFailed == vChecks.size()) return true;
+
+    nFailedIn = nFailed;
+    // Classify the failure as CheckInputScripts does: if the input passes
+    // without the non-mandatory flags, it is non-standard rather than
+    // invalid, so that peers relaying it are not punished.
+    if ((flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) && CheckInputScriptRecorded(ws, nFailed, flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, txdata)) {
+        return state.Invalid(TxValidationResult::TX_NOT_STANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(error)));
+    }
+    return state.Invalid(TxValidationResult::TX_CONSENSUS, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(error)));
+}
+
 bool MemPoolAccept::ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata)
 {
     const CTransaction& tx = *ws.m_ptx;
     const uint256& hash = ws.m_hash;
 
-    TxValidationState &state = args.m_state;
-    const CChainParams& chainparams = args.m_chainparams;
+    TxValidationState &state = args.m_state;
+
+    // Check again against the current block tip's script verification
+    // flags to cache our script execution flags. This is, of course,
+    // useless if the next block has different script flags from the
+    // previous one, but because the cache tracks script flags for us it
+    // will auto-invalidate and we'll just have a few blocks of extra
+    // misses on soft-fork activation.
+    //
+    // This is also useful in case of bugs in the standard flags that cause
+    // transactions to pass as valid when they're actually invalid. For
+    // instance the STRICTENC flag was incorrectly allowing certain
+    // CHECKSIG NOT scripts to pass, even though they were invalid.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks (using TestBlockValidity), however allowing such
+    // transactions into the mempool can be exploited as a DoS attack.
+    //
+    // Input scripts are only verified again if the policy pass did not
+    // already verify them with flags covering the tip's, which is the common
+    // case when the policy flags are a superset of the consensus ones. The
+    // coins they were verified against are checked against the mempool and
+    // the chainstate either way.
+    if (ws.m_script_results.IsCovered(m_tip->m_script_flags)) {
+        if (!CheckInputCoinsFromMempoolAndCache(tx, m_view, m_pool)) {
+            return error("%s: BUG! PLEASE REPORT THIS! inputs of %s missing after the policy script checks",
+                    __func__, hash.ToString());
+        }
+        AddToScriptExecutionCache(tx, m_tip->m_script_flags);
+    } else if (!CheckInputsFromMempoolAndCache(tx, state, m_view, m_pool, m_tip->m_script_flags, txdata)) {
+        return error("%s: BUG! PLEASE REPORT THIS! CheckInputScripts failed against latest-block but not STANDARD flags %s, %s",
+                __func__, hash.ToString(), FormatStateMessage(state));
+    }
+    // SYSCOIN
+    // the sender signed both sides of the double spend, keep the evidence
+    if(args.m_duplicate && !ws.m_double_spends.empty()){
+        CAssetAllocation theAssetAllocation(tx);
+        if(!theAssetAllocation.assetAllocationTuple.IsNull())
+            AddAssetAllocationDoubleSpendEvidence(theAssetAllocation.assetAllocationTuple, ws.m_double_spends);
+    }
+    if (IsSyscoinTx(tx.nVersion) && !CheckSyscoinInputs(tx, hash, state, m_view, true, m_tip->m_height, m_tip->m_median_time_past, args.m_test_accept || args.m_bypass_limits)) {
+        // mark to remove from mempool, because if we remove right away then the transaction data cannot be relayed most of the time
+        if(!args.m_test_accept && state.IsError()){
+            LogPrint(BCLog::SYS, "Double spend detected on tx %s! %s\n", hash.GetHex(), FormatStateMessage(state));
+            g_zdag_removals.Push(hash, m_tip->m_median_time_past);
+            // the sender may not double spend again until the tip moves on
+            CAssetAllocation theAssetAllocation(tx);
+            if(!theAssetAllocation.assetAllocationTuple.IsNull())
+                AddAssetAllocationConflict(GetAssetAllocationConflictActor(theAssetAllocation, tx.nVersion), m_tip->m_median_time_past);
+        }
+        else
+            return false;
+    }else if(args.m_duplicate){
+        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
+    }
+    return true;
+}
+
+
+
+/**
+
+	part 2
+	Accept Transaction in MemPool 
+
+**/
+
+/** Whether tx passes the checks PreChecks runs before it looks at the mempool or any input */
+static bool PassesContextFreePreChecks(const CTransaction& tx)
+{
+    TxValidationState state;
+    std::string reason;
+    return CheckTransaction(tx, state) && !tx.IsCoinBase() &&
+        (!fRequireStandard || IsStandardTx(tx, reason)) &&
+        ::GetSerializeSize(tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) >= MIN_STANDARD_TX_NONWITNESS_SIZE &&
+        CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS);
+}
+
+void MemPoolAccept::PrefetchInputs(const std::vector<CTransactionRef>& txns, const std::vector<std::vector<COutPoint>*>& vCoinsToUncache)
+{
+    AssertLockHeld(cs_main);
+    assert(txns.size() == vCoinsToUncache.size());
+    CCoinsViewCache& coins_cache = ::ChainstateActive().CoinsTip();
+
+    // Outputs created by the transactions themselves are never on disk. A
+    // transaction cannot spend its own outputs, so a single one needs no list.
+    std::vector<uint256> vTxids;
+    if (txns.size() > 1) {
+        vTxids.reserve(txns.size());
+        for (const CTransactionRef& ptx : txns) {
+            vTxids.push_back(ptx->GetHash());
+        }
+        std::sort(vTxids.begin(), vTxids.end());
+    }
+    std::vector<std::pair<COutPoint, size_t>> vMissing;
+    for (size_t i = 0; i < txns.size(); i++) {
+        const CTransaction& tx = *txns[i];
+        // PreChecks turns these away before looking at any input
+        if (g_recent_rejects.Contains(m_tip->m_hash, tx.GetWitnessHash(), false)) continue;
+        if (!PassesContextFreePreChecks(tx)) continue;
+        for (const CTxIn& txin : tx.vin) {
+            if (!std::binary_search(vTxids.begin(), vTxids.end(), txin.prevout.hash) && !coins_cache.HaveCoinInCache(txin.prevout)) {
+                vMissing.emplace_back(txin.prevout, i);
+            }
+        }
+    }
+    if (vMissing.empty()) return;
+    {
+        LOCK(m_pool.cs);
+        // transactions already in the mempool are turned away too
+        vMissing.erase(std::remove_if(vMissing.begin(), vMissing.end(), [&](const std::pair<COutPoint, size_t>& missing) {
+            return m_pool.exists(missing.first.hash) || m_pool.exists(txns[missing.second]->GetHash());
+        }), vMissing.end());
+    }
+
+    // Coins are keyed by outpoint in the database, so reading them in order
+    // turns random seeks into a mostly sequential scan.
+    std::sort(vMissing.begin(), vMissing.end());
+    for (size_t k = 0; k < vMissing.size(); k++) {
+        const COutPoint& outpoint = vMissing[k].first;
+        if (k > 0 && outpoint == vMissing[k - 1].first) continue;
+        // Note: this call adds outpoint to the coins cache if it exists
+        if (coins_cache.HaveCoin(outpoint)) {
+            vCoinsToUncache[vMissing[k].second]->push_back(outpoint);
+        }
+    }
+}
+
+bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args)
+{
+    AssertLockHeld(cs_main);
+
+    // Admissions touching the same outpoints or asset allocation sender are
+    // serialized from PreChecks to Finalize, which lets us release m_pool.cs
+    // while the scripts are verified. Partitions are taken before m_pool.cs.
+    AssertLockNotHeld(m_pool.cs);
+    std::vector<uint64_t> vPartitionKeys;
+    GetAdmissionPartitionKeys(*ptx, vPartitionKeys);
+    CAdmissionPartitionGuard partitions(g_admission_partitions, vPartitionKeys);
+
+    const MempoolTxClass txclass = GetMempoolTxClass(ptx->nVersion);
+    Workspace workspace(ptx);
+    uint64_t nPoolUpdated;
+    {
+        LOCK(m_pool.cs);
+        CAcceptStageTimer timer(MempoolAcceptStage::PRECHECKS, txclass);
+        if (!PreChecks(args, workspace)) return false;
+        nPoolUpdated = m_pool.GetTransactionsUpdated();
+    }
+    // A transaction that just passed test accept on this tip needs none of
+    // its scripts verified again; everything depending on the mempool was
+    // redone by PreChecks above.
+    if (!args.m_test_accept) {
+        g_test_accept_cache.Take(m_tip->m_hash, ptx->GetWitnessHash(), workspace.m_script_results);
+    }
+    // Only compute the precomputed transaction data if we need to verify
+    // scripts (ie, other policy checks pass). We perform the inexpensive
+    // checks first and avoid hashing and signature verification unless those
+    // checks pass, to mitigate CPU exhaustion denial-of-service attacks.
+    PrecomputedTransactionData txdata(*ptx);
+    {
+        CAcceptStageTimer timer(MempoolAcceptStage::POLICY_SCRIPTS, txclass);
+        if (!PolicyScriptChecks(args, workspace, txdata)) return false;
+    }
+
+    LOCK(m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+    // Transactions outside our partitions may have been added or removed in
+    // the meantime, which could invalidate the conflict and ancestor sets
+    // computed above. Redo the (cheap) PreChecks in that case.
+    Workspace workspace_retry(ptx);
+    Workspace* ws = &workspace;
+    if (m_pool.GetTransactionsUpdated() != nPoolUpdated) {
+        ws = &workspace_retry;
+        ForgetCachedInputs(*ptx);
+        CAcceptStageTimer timer(MempoolAcceptStage::PRECHECKS, txclass);
+        if (!PreChecks(args, *ws)) return false;
+        // same inputs, so the script results still hold
+        ws->m_script_results = std::move(workspace.m_script_results);
+    }
+    {
+        CAcceptStageTimer timer(MempoolAcceptStage::CONSENSUS_SCRIPTS, txclass);
+        if (!ConsensusScriptChecks(args, *ws, txdata)) return false;
+    }
+    // Tx was accepted, but not added
+    if (args.m_test_accept) {
+        g_test_accept_cache.Add(m_tip->m_hash, ptx->GetWitnessHash(), ws->m_script_results);
+        return true;
+    }
+    {
+        CAcceptStageTimer timer(MempoolAcceptStage::FINALIZE, txclass);
+        if (!Finalize(args, *ws)) return false;
+    }
+    GetMainSignals().TransactionAddedToMempool(ptx);
+    return true;
+}
+
+void MemPoolAccept::AcceptTransactionsParallel(const std::vector<CTransactionRef>& txns, std::vector<ATMPArgs>& args, std::vector<bool>& results, bool fPoolLocked)
+{
+    AssertLockHeld(cs_main);
+    if (!fPoolLocked) AssertLockNotHeld(m_pool.cs);
+    assert(txns.size() == args.size());
+    results.assign(txns.size(), false);
+    m_limit_in_finalize = false;
+
+    std::vector<std::vector<COutPoint>*> vCoinsToUncache;
+    for (ATMPArgs& arg : args) {
+        vCoinsToUncache.push_back(&arg.m_coins_to_uncache);
+    }
+    PrefetchInputs(txns, vCoinsToUncache);
+
+    // Admit the set in topological order, one generation per round: a
+    // transaction is only checked in the round after the last of its parents
+    // in the set, so the members of a round never depend on each other and
+    // no transaction is checked before its parents had their chance to get
+    // into the mempool.
+    std::vector<std::vector<size_t>> vChildren(txns.size());
+    std::vector<size_t> vParentCount(txns.size(), 0);
+    if (txns.size() > 1) {
+        std::unordered_map<uint256, size_t, SaltedTxidHasher> mapIndex;
+        for (size_t i = 0; i < txns.size(); i++) {
+            mapIndex.emplace(txns[i]->GetHash(), i);
+        }
+        for (size_t i = 0; i < txns.size(); i++) {
+            for (const CTxIn& txin : txns[i]->vin) {
+                auto it = mapIndex.find(txin.prevout.hash);
+                if (it == mapIndex.end() || it->second == i) continue;
+                vChildren[it->second].push_back(i);
+                vParentCount[i]++;
+            }
+        }
+    }
+    std::vector<size_t> vPending;
+    for (size_t i = 0; i < txns.size(); i++) {
+        if (vParentCount[i] == 0) vPending.push_back(i);
+    }
+    while (!vPending.empty()) {
+        // Every round takes the partitions of all its transactions at once,
+        // so the round cannot deadlock against other admissions. A caller
+        // holding m_pool.cs already excludes the other admissions from the
+        // mempool and must not take them, see CAdmissionPartitions.
+        std::unique_ptr<CAdmissionPartitionGuard> partitions;
+        if (!fPoolLocked) {
+            std::vector<uint64_t> vPartitionKeys;
+            for (const size_t i : vPending) {
+                GetAdmissionPartitionKeys(*txns[i], vPartitionKeys);
+            }
+            partitions = MakeUnique<CAdmissionPartitionGuard>(g_admission_partitions, vPartitionKeys);
+        }
+
+        std::vector<size_t> vChecked;
+        std::vector<std::unique_ptr<Workspace>> workspaces;
+        std::vector<std::unique_ptr<PrecomputedTransactionData>> txdata;
+        std::vector<CMempoolScriptCheckPool::Job> jobs;
+
+        {
+            LOCK(m_pool.cs);
+            for (const size_t i : vPending) {
+                std::unique_ptr<Workspace> ws = MakeUnique<Workspace>(txns[i]);
+                // an earlier round may have replaced or evicted a parent
+                ForgetCachedInputs(*txns[i]);
+                bool fPreChecks;
+                {
+                    CAcceptStageTimer timer(MempoolAcceptStage::PRECHECKS, GetMempoolTxClass(txns[i]->nVersion));
+                    fPreChecks = PreChecks(args[i], *ws);
+                }
+                if (!fPreChecks) continue;
+                // Collect the per-input script checks with our policy flags.
+                // All inputs are in m_view at this point, and the checks keep
+                // their own copy of the spent outputs, so they can run without
+                // any lock held.
+                std::unique_ptr<PrecomputedTransactionData> ptxdata = MakeUnique<PrecomputedTransactionData>(*txns[i]);
+                CMempoolScriptCheckPool::Job job;
+                TxValidationState state_dummy;
+                if (!args[i].m_test_accept && g_test_accept_cache.Take(m_tip->m_hash, txns[i]->GetWitnessHash(), ws->m_script_results)) {
+                    // passed test accept on this tip just before
+                    job.m_result = true;
+                    job.m_done = true;
+                } else if (!CheckInputScripts(*txns[i], state_dummy, m_view, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, *ptxdata, &job.m_checks)) {
+                    job.m_checks.clear();
+                    job.m_result = false;
+                    job.m_done = true;
+                }
+                vChecked.push_back(i);
+                workspaces.push_back(std::move(ws));
+                txdata.push_back(std::move(ptxdata));
+                jobs.push_back(std::move(job));
+            }
+        }
+
+        // Signature verification for the whole set runs here, on the script
+        // check threads, while other threads are free to use the mempool.
+        g_mempool_script_check_pool.Run(jobs);
+
+        // Set once an earlier transaction of this round evicted or replaced
+        // mempool entries, as iterators held by later workspaces may dangle.
+        bool fPoolShrunk = false;
+        // Ancestors of the transactions committed so far this round, whose
+        // descendant aggregates grew after the later workspaces were checked
+        std::unordered_set<uint256, SaltedTxidHasher> setGrownAncestors;
+        LOCK(m_pool.cs);
+        for (size_t n = 0; n < vChecked.size(); n++) {
+            const size_t i = vChecked[n];
+            const CTransactionRef& ptx = txns[i];
+            TxValidationState& state = args[i].m_state;
+            const MempoolTxClass txclass = GetMempoolTxClass(ptx->nVersion);
+            if (jobs[n].m_result) {
+                g_mempool_accept_stats.Record(MempoolAcceptStage::POLICY_SCRIPTS, txclass, jobs[n].m_micros);
+            }
+            // Keep the inputs that passed, so neither the rerun of a failure
+            // nor the consensus pass verifies them again. The checks are in
+            // input order; none are built on a script execution cache hit.
+            CInputScriptResults& script_results = workspaces[n]->m_script_results;
+            script_results.Init(ptx->vin.size());
+            if (jobs[n].m_result && jobs[n].m_checks.empty()) {
+                script_results.SetAllPassed(STANDARD_SCRIPT_VERIFY_FLAGS);
+            } else {
+                for (size_t j = 0; j < jobs[n].m_passed; j++) {
+                    script_results.Set(j, STANDARD_SCRIPT_VERIFY_FLAGS, true);
+                }
+            }
+
+            // Rerun failures serially to report the same reject reason as the
+            // single transaction path, including TX_WITNESS_MUTATED.
+            if (!jobs[n].m_result) {
+                CAcceptStageTimer timer(MempoolAcceptStage::POLICY_SCRIPTS, txclass);
+                if (!PolicyScriptChecks(args[i], *workspaces[n], *txdata[n])) continue;
+            }
+
+            if (m_pool.exists(ptx->GetHash())) {
+                state.Invalid(TxValidationResult::TX_CONFLICT, "txn-already-in-mempool");
+                continue;
+            }
+            // The descendant limits and the carve-out were checked against the
+            // mempool before the round, so they are checked again once another
+            // transaction of the round became a descendant of a shared ancestor.
+            bool fAncestorGrown = false;
+            if (!fPoolShrunk) {
+                for (CTxMemPool::txiter ancestor : workspaces[n]->m_ancestors) {
+                    if (setGrownAncestors.count(ancestor->GetTx().GetHash())) {
+                        fAncestorGrown = true;
+                        break;
+                    }
+                }
+            }
+            if (fPoolShrunk || fAncestorGrown) {
+                CInputScriptResults script_results = std::move(workspaces[n]->m_script_results);
+                workspaces[n] = MakeUnique<Workspace>(ptx);
+                ForgetCachedInputs(*ptx);
+                CAcceptStageTimer timer(MempoolAcceptStage::PRECHECKS, txclass);
+                if (!PreChecks(args[i], *workspaces[n])) continue;
+                workspaces[n]->m_script_results = std::move(script_results);
+            } else {
+                // The inputs must still be unspent by anything we are not
+                // about to replace.
+                bool fConflict = false;
+                for (const CTxIn& txin : ptx->vin) {
+                    const CTransaction* ptxConflicting = m_pool.GetConflictTx(txin.prevout);
+                    if (ptxConflicting && !workspaces[n]->m_conflicts.count(ptxConflicting->GetHash())) {
+                        fConflict = true;
+                        break;
+                    }
+                }
+                if (fConflict) {
+                    state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
+                    continue;
+                }
+            }
+
+            // Signatures are in the signature cache by now, so this is cheap.
+            {
+                CAcceptStageTimer timer(MempoolAcceptStage::CONSENSUS_SCRIPTS, txclass);
+                if (!ConsensusScriptChecks(args[i], *workspaces[n], *txdata[n])) continue;
+            }
+            if (args[i].m_test_accept) {
+                g_test_accept_cache.Add(m_tip->m_hash, ptx->GetWitnessHash(), workspaces[n]->m_script_results);
+                results[i] = true;
+                continue;
+            }
+            const size_t nPoolSize = m_pool.size();
+            bool fAdded;
+            {
+                CAcceptStageTimer timer(MempoolAcceptStage::FINALIZE, txclass);
+                fAdded = Finalize(args[i], *workspaces[n]);
+            }
+            if (m_pool.size() != nPoolSize + 1) fPoolShrunk = true;
+            if (!fAdded) continue;
+            if (!fPoolShrunk) {
+                for (CTxMemPool::txiter ancestor : workspaces[n]->m_ancestors) {
+                    setGrownAncestors.insert(ancestor->GetTx().GetHash());
+                }
+            }
+            GetMainSignals().TransactionAddedToMempool(ptx);
+            results[i] = true;
+        }
+
+        // Children of transactions that did not make it fail with missing
+        // inputs, which PreChecks finds out cheaply.
+        std::vector<size_t> vNext;
+        for (const size_t i : vPending) {
+            for (const size_t child : vChildren[i]) {
+                if (--vParentCount[child] == 0) vNext.push_back(child);
+            }
+        }
+        vPending = std::move(vNext);
+    }
+}
+
+} // anon namespace
+
+/**
+ * Start the background services of mempool admission on the first admission.
+ * LoadMempool admits through here, so they come up at startup; shutdown stops
+ * them with StopMempoolAdmissionServices.
+ */
+static void StartMempoolAdmissionServices(CTxMemPool& pool)
+{
+    static std::once_flag start_flag;
+    static std::once_flag index_flag;
+    // the index follows the node's mempool only, not pools of other callers;
+    // the first admission is at the latest the first one of LoadMempool
+    if (&pool == &::mempool) std::call_once(index_flag, [&pool] { StartMempoolTxIndex(pool); });
+    std::call_once(start_flag, [] {
+        // The matching stops are in StopMempoolAdmissionServices.
+        StartMempoolTipContextPublisher();
+        StartMempoolScriptCheckThreads();
+        StartStateFlushThread();
+        StartAdmissionRecorder();
+        // SYSCOIN
+        StartZdagEvidenceStore();
+    });
+}
+
+static void StopMempoolExpiryTimers();
+static void StopMempoolAncestorChains();
+
+void StopMempoolAdmissionServices()
+{
+    StopMempoolTxIndex();
+    StopMempoolScriptCheckThreads();
+    StopStateFlushThread();
+    StopMempoolTipContextPublisher();
+    StopMempoolExpiryTimers();
+    StopMempoolAncestorChains();
+}
+
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
+                        int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
+                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    StartMempoolAdmissionServices(pool);
+    std::vector<COutPoint> coins_to_uncache;
+    // SYSCOIN
+    bool bDuplicate = false;
+    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept, bDuplicate };
+	
+	// If taskNumber is within a specified range and acceptTime is runnable, we perform accept single transaction
+	int taskNumber = pool.size;
+	int schedulableNumber = isScheduable(pool);
+	int64_t runnableTime = isRunnable(pool,state);
+	bool res = false;
+	const bool fRecordArrival = g_admission_recorder.ShouldRecord();
+	const int64_t nArrival = fRecordArrival ? CAdmissionRecorder::NowMicros() : 0;
+	const int64_t nTimeStart = GetTimeMicros();
+	if( taskNumber < schedulableNumber && nAcceptTime < runnableTime )
+		res = MemPoolAccept(pool).AcceptSingleTransaction(tx, args);
+    const int64_t nElapsed = GetTimeMicros() - nTimeStart;
+    g_mempool_accept_stats.Record(MempoolAcceptStage::TOTAL, GetMempoolTxClass(tx->nVersion), nElapsed);
+    if (!res && state.IsInvalid()) {
+        g_mempool_accept_stats.RecordReject(state.GetRejectReason(), nElapsed);
+    }
+    if (fRecordArrival) {
+        g_admission_recorder.Record(tx->GetHash(), nArrival, GetAdmissionOutcome(res, state));
+    }
+    if (!res) {
+        g_recent_rejects.Add(GetMempoolTipContext()->m_hash, *tx, state);
+        // Remove coins that were not present in the coins cache before calling ATMPW;
+        // this is to prevent memory DoS in case we receive a large number of
+        // invalid transactions that attempt to overrun the in-memory coins cache
+        // (`CCoinsViewCache::cacheCoins`).
+
+        for (const COutPoint& hashTx : coins_to_uncache)
+            ::ChainstateActive().CoinsTip().Uncache(hashTx);
+    }
+    // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
+    g_state_flusher.RequestFlushIfNeeded(chainparams);
+    return res;
+}
+
+bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
+                        std::list<CTransactionRef>* plTxnReplaced,
+                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept)
+{
+    const CChainParams& chainparams = Params();
+    return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
+}
+
+/**
+ * (try to) add a batch of transactions to the memory pool. The locks are taken
+ * once, one MemPoolAccept (and so one coins view) is shared by the whole batch,
+ * script checks run in parallel (see AcceptTransactionsParallel), and the
+ * mempool size limit and the coins cache flush check run once at the end.
+ * states[i] and results[i] are filled in for txns[i]. Transactions may spend
+ * outputs of other transactions in the batch, in any order. fPoolLocked is
+ * set if the caller holds pool.cs throughout.
+ */
+static void AcceptToMemoryPoolBatchImpl(CTxMemPool& pool, const std::vector<CTransactionRef>& txns, std::vector<TxValidationState>& states,
+                        std::vector<bool>& results, bool bypass_limits, const std::vector<CAmount>& vAbsurdFee, bool test_accept,
+                        std::vector<std::list<CTransactionRef>>* pvReplaced, bool fPoolLocked) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    assert(vAbsurdFee.empty() || vAbsurdFee.size() == txns.size());
+    StartMempoolAdmissionServices(pool);
+    const CChainParams& chainparams = Params();
+    const int64_t nAcceptTime = GetTime();
+    const CAmount nNoAbsurdFee = 0;
+    const bool fRecordArrival = g_admission_recorder.ShouldRecord();
+    const int64_t nArrival = fRecordArrival ? CAdmissionRecorder::NowMicros() : 0;
+    states.assign(txns.size(), TxValidationState());
+    std::vector<std::vector<COutPoint>> coins_to_uncache(txns.size());
+    // SYSCOIN
+    std::unique_ptr<bool[]> duplicates(new bool[txns.size()]());
+    if (pvReplaced) pvReplaced->assign(txns.size(), std::list<CTransactionRef>());
+    std::vector<MemPoolAccept::ATMPArgs> args;
+    args.reserve(txns.size());
+    for (size_t i = 0; i < txns.size(); i++) {
+        const CAmount& nAbsurdFee = vAbsurdFee.empty() ? nNoAbsurdFee : vAbsurdFee[i];
+        std::list<CTransactionRef>* plTxnReplaced = pvReplaced ? &(*pvReplaced)[i] : nullptr;
+        args.push_back(MemPoolAccept::ATMPArgs{ chainparams, states[i], nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache[i], test_accept, duplicates[i] });
+    }
+    MemPoolAccept(pool).AcceptTransactionsParallel(txns, args, results, fPoolLocked);
+
+    // trim mempool once for the whole batch and check which txs were trimmed
+    if (!bypass_limits && !test_accept) {
+        LOCK(pool.cs);
+        const std::shared_ptr<const MempoolPolicy> policy = GetMempoolPolicy();
+        TrimMempoolAmortized(pool, policy->m_max_mempool_size, policy->m_trim_percent, policy->m_expiry);
+        for (size_t i = 0; i < txns.size(); i++) {
+            if (results[i] && !pool.exists(txns[i]->GetHash())) {
+                results[i] = false;
+                states[i].Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
+            }
+        }
+    }
+    const uint256 tip_hash = GetMempoolTipContext()->m_hash;
+    for (size_t i = 0; i < txns.size(); i++) {
+        if (fRecordArrival) {
+            g_admission_recorder.Record(txns[i]->GetHash(), nArrival, GetAdmissionOutcome(results[i], states[i]));
+        }
+        if (results[i]) continue;
+        g_recent_rejects.Add(tip_hash, *txns[i], states[i]);
+        for (const COutPoint& hashTx : coins_to_uncache[i])
+            ::ChainstateActive().CoinsTip().Uncache(hashTx);
+    }
+    // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
+    g_state_flusher.RequestFlushIfNeeded(chainparams);
+}
+
+void AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txns, std::vector<TxValidationState>& states,
+                        std::vector<bool>& results, bool bypass_limits, const std::vector<CAmount>& vAbsurdFee, bool test_accept,
+                        std::vector<std::list<CTransactionRef>>* pvReplaced)
+{
+    AcceptToMemoryPoolBatchImpl(pool, txns, states, results, bypass_limits, vAbsurdFee, test_accept, pvReplaced, false /* fPoolLocked */);
+}
+
+
+
+/**
+
+	part 3
+	main class
+
+**/
+
+static std::shared_ptr<const CMempoolTipContext> g_mempool_tip_context;
+
+void UpdateMempoolTipContext(const CBlockIndex* pindexNew, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    assert(pindexNew);
+    std::shared_ptr<CMempoolTipContext> tip = std::make_shared<CMempoolTipContext>();
+    tip->m_hash = pindexNew->GetBlockHash();
+    tip->m_height = pindexNew->nHeight;
+    tip->m_median_time_past = pindexNew->GetMedianTimePast();
+    tip->m_block_time = pindexNew->GetBlockTime();
+    tip->m_best_header_height = pindexBestHeader ? pindexBestHeader->nHeight : pindexNew->nHeight;
+    tip->m_script_flags = GetBlockScriptFlags(pindexNew, chainparams.GetConsensus());
+    tip->m_initial_block_download = ::ChainstateActive().IsInitialBlockDownload();
+    std::atomic_store(&g_mempool_tip_context, std::shared_ptr<const CMempoolTipContext>(std::move(tip)));
+}
+
+/**
+ * Publishes a new tip context on every tip change. UpdatedBlockTip runs on
+ * the validation interface queue, so an admission between the tip update and
+ * the notification still validates against the previous tip, as it would
+ * have had it run a moment earlier.
+ */
+class CMempoolTipContextPublisher final : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        const std::shared_ptr<const CMempoolTipContext> old_tip = std::atomic_load(&g_mempool_tip_context);
+        {
+            LOCK(cs_main);
+            UpdateMempoolTipContext(pindexNew, Params());
+        }
+        // SYSCOIN the block that replaced old_tip settled the double spends detected against it
+        if (old_tip && old_tip->m_hash != pindexNew->GetBlockHash()) {
+            PruneAssetAllocationConflicts(old_tip->m_median_time_past);
+        }
+    }
+};
+
+static CMempoolTipContextPublisher g_mempool_tip_publisher;
+
+void StartMempoolTipContextPublisher()
+{
+    RegisterValidationInterface(&g_mempool_tip_publisher);
+    LOCK(cs_main);
+    UpdateMempoolTipContext(::ChainActive().Tip(), Params());
+}
+
+void StopMempoolTipContextPublisher()
+{
+    UnregisterValidationInterface(&g_mempool_tip_publisher);
+}
+
+std::shared_ptr<const CMempoolTipContext> GetMempoolTipContext()
+{
+    std::shared_ptr<const CMempoolTipContext> tip = std::atomic_load(&g_mempool_tip_context);
+    if (!tip) {
+        // only until the publisher has started
+        LOCK(cs_main);
+        UpdateMempoolTipContext(::ChainActive().Tip(), Params());
+        tip = std::atomic_load(&g_mempool_tip_context);
+    }
+    return tip;
+}
+
+// SYSCOIN
+bool IsTipBeforeBridgeStart()
+{
+    // Never read from the snapshot: the asset allocation serializers calling
+    // this also run while blocks are connected, before any admission.
+    return ::ChainActive().Tip()->nHeight <= Params().GetConsensus().nBridgeStartBlock;
+}
+
+/** Default for -mempooltrimpercent */
+static const unsigned int DEFAULT_MEMPOOL_TRIM_PERCENT = 90;
+
+static std::shared_ptr<const MempoolPolicy> g_mempool_policy;
+
+bool MempoolPolicy::IsValid(std::string& strError) const
+{
+    // same lower bound init applies to -maxmempool
+    const size_t nMinMempoolSize = m_limit_descendant_size * 40;
+    if (m_max_mempool_size < nMinMempoolSize) {
+        strError = strprintf("maxmempool must be at least %d MB", std::ceil(nMinMempoolSize / 1000000.0));
+        return false;
+    }
+    if (m_asset_allocation_fee_multiplier == 0) {
+        strError = "assetallocationfeemultiplier must be at least 1";
+        return false;
+    }
+    if (m_trim_percent == 0 || m_trim_percent > 100) {
+        strError = "mempooltrimpercent must be between 1 and 100";
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<MempoolPolicy> MakeMempoolPolicyFromArgs()
+{
+    std::shared_ptr<MempoolPolicy> policy = std::make_shared<MempoolPolicy>();
+    policy->m_limit_ancestors = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    policy->m_limit_ancestor_size = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+    policy->m_limit_descendants = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    policy->m_limit_descendant_size = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+    policy->m_max_mempool_size = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    policy->m_expiry = std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)};
+    policy->m_trim_percent = std::max<int64_t>(1, std::min<int64_t>(100, gArgs.GetArg("-mempooltrimpercent", DEFAULT_MEMPOOL_TRIM_PERCENT)));
+    policy->m_min_relay_fee = ::minRelayTxFee;
+    policy->m_incremental_relay_fee = ::incrementalRelayFee;
+    policy->m_asset_allocation_fee_multiplier = 2;
+    return policy;
+}
+
+std::shared_ptr<const MempoolPolicy> GetMempoolPolicy()
+{
+    std::shared_ptr<const MempoolPolicy> policy = std::atomic_load(&g_mempool_policy);
+    if (!policy) {
+        std::shared_ptr<const MempoolPolicy> policy_new = MakeMempoolPolicyFromArgs();
+        // another thread may have published a policy in the meantime, keep that one
+        if (std::atomic_compare_exchange_strong(&g_mempool_policy, &policy, policy_new)) {
+            policy = std::move(policy_new);
+        }
+    }
+    return policy;
+}
+
+void SetMempoolPolicy(std::shared_ptr<const MempoolPolicy> policy)
+{
+    assert(policy);
+    // Mempool trimming, fee filters, getmempoolinfo and the wallet still read
+    // the relay fees from the globals, so keep them in step with the policy.
+    LOCK2(cs_main, ::mempool.cs);
+    ::minRelayTxFee = policy->m_min_relay_fee;
+    ::incrementalRelayFee = policy->m_incremental_relay_fee;
+    std::atomic_store(&g_mempool_policy, std::move(policy));
+}
+
+/**
+ * Rolling bloom filter of the wtxids of transactions recently rejected by
+ * mempool admission, checked at the very top of PreChecks so that
+ * resubmitted invalid transactions are turned away before any coins are
+ * fetched. Validity may change with the tip, so the filter is reset
+ * whenever the tip it was filled against is replaced. Only rejects that do
+ * not depend on the mempool contents or the caller are remembered; Syscoin
+ * transactions never are, since CheckSyscoinInputs checks them against the
+ * ZDAG mempool balances.
+ */
+class CRecentRejectsFilter
+{
+public:
+    CRecentRejectsFilter() : m_filter(120000, 0.000001) {}
+
+    /** Return true if wtxid was rejected since the tip tip_hash was connected */
+    bool Contains(const uint256& tip_hash, const uint256& wtxid, bool fCount = true);
+    /** Remember the rejection of tx against tip_hash if state is worth remembering */
+    void Add(const uint256& tip_hash, const CTransaction& tx, const TxValidationState& state);
+    RecentRejectsStats GetStats() const;
+
+private:
+    static bool IsCacheable(const CTransaction& tx, const TxValidationState& state);
+    void ResetIfStale(const uint256& tip_hash) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    Mutex m_mutex;
+    CRollingBloomFilter m_filter GUARDED_BY(m_mutex);
+    uint256 m_tip_hash GUARDED_BY(m_mutex);
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_inserts{0};
+    std::atomic<uint64_t> m_resets{0};
+};
+
+CRecentRejectsFilter g_recent_rejects;
+
+bool CRecentRejectsFilter::IsCacheable(const CTransaction& tx, const TxValidationState& state)
+{
+    if (!state.IsInvalid()) return false;
+    // SYSCOIN the state does not tell a CheckSyscoinInputs reject, which may
+    // clear once the sender's mempool balance changes, from the others
+    if (IsSyscoinTx(tx.nVersion)) return false;
+    switch (state.GetResult()) {
+    // parents may still arrive, or conflicts may leave the mempool
+    case TxValidationResult::TX_MISSING_INPUTS:
+    case TxValidationResult::TX_CONFLICT:
+    // fee, chain and size limits depend on the current mempool contents
+    case TxValidationResult::TX_MEMPOOL_POLICY:
+        return false;
+    default:
+        // the absurd fee limit is chosen by the caller
+        return state.GetRejectReason() != "absurdly-high-fee";
+    }
+}
+
+void CRecentRejectsFilter::ResetIfStale(const uint256& tip_hash)
+{
+    if (tip_hash != m_tip_hash) {
+        m_filter.reset();
+        m_tip_hash = tip_hash;
+        ++m_resets;
+    }
+}
+
+bool CRecentRejectsFilter::Contains(const uint256& tip_hash, const uint256& wtxid, bool fCount)
+{
+    LOCK(m_mutex);
+    ResetIfStale(tip_hash);
+    const bool fContains = m_filter.contains(wtxid);
+    if (fCount && fContains) ++m_hits;
+    if (fCount && !fContains) ++m_misses;
+    return fContains;
+}
+
+void CRecentRejectsFilter::Add(const uint256& tip_hash, const CTransaction& tx, const TxValidationState& state)
+{
+    if (!IsCacheable(tx, state)) return;
+    LOCK(m_mutex);
+    ResetIfStale(tip_hash);
+    m_filter.insert(tx.GetWitnessHash());
+    ++m_inserts;
+}
+
+RecentRejectsStats CRecentRejectsFilter::GetStats() const
+{
+    return RecentRejectsStats{m_hits.load(), m_misses.load(), m_inserts.load(), m_resets.load()};
+}
+
+RecentRejectsStats GetRecentRejectsStats()
+{
+    return g_recent_rejects.GetStats();
+}
+
+/**
+ * Lock-free log-linear latency histogram. Values below 8us get a bucket each,
+ * above that every power of two is split into 8 buckets, so a recorded value
+ * is reported at most 12.5% too high. Recording is a few relaxed atomic
+ * increments; a snapshot taken while other threads record may be off by the
+ * samples in flight, which is fine for monitoring.
+ */
+class CLatencyHistogram
+{
+public:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    /** Values are capped at 2^40us (about 12 days) */
+    static constexpr int MAX_VALUE_BITS = 40;
+    static constexpr int NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void Record(int64_t nMicros);
+    void Reset();
+    MempoolLatencySummary Summarize() const;
+
+private:
+    static int BucketIndex(uint64_t nValue);
+    static uint64_t BucketUpperBound(int nIndex);
+
+    std::atomic<uint64_t> m_buckets[NUM_BUCKETS]{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_total{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+int CLatencyHistogram::BucketIndex(uint64_t nValue)
+{
+    if (nValue < (uint64_t)SUB_BUCKETS) return (int)nValue;
+    nValue = std::min(nValue, (uint64_t{1} << MAX_VALUE_BITS) - 1);
+    const int nExponent = CountBits(nValue) - 1;
+    const int nMantissa = (int)((nValue >> (nExponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return (nExponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + nMantissa;
+}
+
+uint64_t CLatencyHistogram::BucketUpperBound(int nIndex)
+{
+    if (nIndex < SUB_BUCKETS) return nIndex;
+    const int nExponent = nIndex / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    const uint64_t nWidth = uint64_t{1} << (nExponent - SUB_BUCKET_BITS);
+    return (uint64_t)(SUB_BUCKETS + nIndex % SUB_BUCKETS) * nWidth + nWidth - 1;
+}
+
+void CLatencyHistogram::Record(int64_t nMicros)
+{
+    const uint64_t nValue = nMicros > 0 ? nMicros : 0;
+    m_buckets[BucketIndex(nValue)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(nValue, std::memory_order_relaxed);
+    uint64_t nMax = m_max.load(std::memory_order_relaxed);
+    while (nValue > nMax && !m_max.compare_exchange_weak(nMax, nValue, std::memory_order_relaxed)) {}
+}
+
+void CLatencyHistogram::Reset()
+{
+    for (std::atomic<uint64_t>& bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_total.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+MempoolLatencySummary CLatencyHistogram::Summarize() const
+{
+    MempoolLatencySummary summary;
+    uint64_t vCounts[NUM_BUCKETS];
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        vCounts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        summary.m_count += vCounts[i];
+    }
+    summary.m_total_micros = m_total.load(std::memory_order_relaxed);
+    summary.m_max_micros = m_max.load(std::memory_order_relaxed);
+    if (summary.m_count == 0) return summary;
+
+    const uint64_t nRank50 = (summary.m_count * 50 + 99) / 100;
+    const uint64_t nRank90 = (summary.m_count * 90 + 99) / 100;
+    const uint64_t nRank99 = (summary.m_count * 99 + 99) / 100;
+    uint64_t nSeen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        if (vCounts[i] == 0) continue;
+        const uint64_t nBefore = nSeen;
+        nSeen += vCounts[i];
+        // a bucket never reports more than the largest value recorded
+        const uint64_t nValue = std::min(BucketUpperBound(i), summary.m_max_micros);
+        if (nBefore < nRank50 && nSeen >= nRank50) summary.m_p50_micros = nValue;
+        if (nBefore < nRank90 && nSeen >= nRank90) summary.m_p90_micros = nValue;
+        if (nBefore < nRank99 && nSeen >= nRank99) summary.m_p99_micros = nValue;
+    }
+    return summary;
+}
+
+/**
+ * Admission latency per MemPoolAccept stage and transaction class, and of
+ * rejected admissions per reject reason. The per-reason histograms are
+ * created on first use under m_reasons_mutex; the lock only guards the map,
+ * recording itself is lock-free.
+ */
+class CMempoolAcceptStats
+{
+public:
+    void Record(MempoolAcceptStage stage, MempoolTxClass txclass, int64_t nMicros)
+    {
+        m_stages[(int)stage][(int)txclass].Record(nMicros);
+    }
+    void RecordReject(const std::string& strReason, int64_t nMicros);
+    MempoolAcceptStats GetStats() const;
+    void Reset();
+
+private:
+    CLatencyHistogram m_stages[(int)MempoolAcceptStage::COUNT][(int)MempoolTxClass::COUNT];
+    mutable Mutex m_reasons_mutex;
+    std::map<std::string, std::unique_ptr<CLatencyHistogram>> m_reasons GUARDED_BY(m_reasons_mutex);
+};
+
+CMempoolAcceptStats g_mempool_accept_stats;
+
+void CMempoolAcceptStats::RecordReject(const std::string& strReason, int64_t nMicros)
+{
+    CLatencyHistogram* histogram;
+    {
+        LOCK(m_reasons_mutex);
+        std::unique_ptr<CLatencyHistogram>& entry = m_reasons[strReason];
+        if (!entry) entry = MakeUnique<CLatencyHistogram>();
+        histogram = entry.get();
+    }
+    histogram->Record(nMicros);
+}
+
+MempoolAcceptStats CMempoolAcceptStats::GetStats() const
+{
+    MempoolAcceptStats stats;
+    for (int stage = 0; stage < (int)MempoolAcceptStage::COUNT; stage++) {
+        for (int txclass = 0; txclass < (int)MempoolTxClass::COUNT; txclass++) {
+            stats.m_stages[stage][txclass] = m_stages[stage][txclass].Summarize();
+        }
+    }
+    LOCK(m_reasons_mutex);
+    for (const auto& reason : m_reasons) {
+        stats.m_rejects.emplace(reason.first, reason.second->Summarize());
+    }
+    return stats;
+}
+
+void CMempoolAcceptStats::Reset()
+{
+    for (auto& stage : m_stages) {
+        for (CLatencyHistogram& histogram : stage) {
+            histogram.Reset();
+        }
+    }
+    // histograms are never freed, a concurrent RecordReject may still hold one
+    LOCK(m_reasons_mutex);
+    for (auto& reason : m_reasons) {
+        reason.second->Reset();
+    }
+}
+
+/** Records the time from construction to destruction as one sample of a stage */
+class CAcceptStageTimer
+{
+public:
+    CAcceptStageTimer(MempoolAcceptStage stage, MempoolTxClass txclass) : m_stage(stage), m_txclass(txclass), m_start(GetTimeMicros()) {}
+    ~CAcceptStageTimer() { g_mempool_accept_stats.Record(m_stage, m_txclass, GetTimeMicros() - m_start); }
+
+private:
+    const MempoolAcceptStage m_stage;
+    const MempoolTxClass m_txclass;
+    const int64_t m_start;
+};
+
+// SYSCOIN
+MempoolTxClass GetMempoolTxClass(int nVersion)
+{
+    if (IsSyscoinMintTx(nVersion))
+        return MempoolTxClass::MINT;
+    if (nVersion == SYSCOIN_TX_VERSION_ALLOCATION_BURN_TO_SYSCOIN || nVersion == SYSCOIN_TX_VERSION_ALLOCATION_BURN_TO_ETHEREUM ||
+            nVersion == SYSCOIN_TX_VERSION_SYSCOIN_BURN_TO_ALLOCATION)
+        return MempoolTxClass::BURN;
+    if (IsAssetTx(nVersion))
+        return MempoolTxClass::ASSET;
+    if (IsAssetAllocationTx(nVersion))
+        return MempoolTxClass::ALLOCATION_SEND;
+    return MempoolTxClass::PLAIN;
+}
+
+std::string MempoolAcceptStageName(MempoolAcceptStage stage)
+{
+    switch (stage) {
+    case MempoolAcceptStage::PRECHECKS: return "prechecks";
+    case MempoolAcceptStage::POLICY_SCRIPTS: return "policyscripts";
+    case MempoolAcceptStage::CONSENSUS_SCRIPTS: return "consensusscripts";
+    case MempoolAcceptStage::FINALIZE: return "finalize";
+    case MempoolAcceptStage::TOTAL: return "total";
+    case MempoolAcceptStage::COUNT: break;
+    }
+    assert(false);
+}
+
+std::string MempoolTxClassName(MempoolTxClass txclass)
+{
+    switch (txclass) {
+    case MempoolTxClass::PLAIN: return "plain";
+    case MempoolTxClass::ASSET: return "asset";
+    case MempoolTxClass::ALLOCATION_SEND: return "assetallocationsend";
+    case MempoolTxClass::BURN: return "burn";
+    case MempoolTxClass::MINT: return "mint";
+    case MempoolTxClass::COUNT: break;
+    }
+    assert(false);
+}
+
+MempoolAcceptStats GetMempoolAcceptStats()
+{
+    return g_mempool_accept_stats.GetStats();
+}
+
+void ResetMempoolAcceptStats()
+{
+    g_mempool_accept_stats.Reset();
+}
+
+/** -admissionrecordsize default (number of arrivals buffered per admitting thread) */
+static const int DEFAULT_ADMISSION_RECORD_SIZE = 8192;
+/** -admissionsamplerate default (record one in N admissions outside a TPS test, 0 = disabled) */
+static const int DEFAULT_ADMISSION_SAMPLE_RATE = 0;
+
+/**
+ * Records the arrival of transactions at mempool admission for the TPS test
+ * (while nTPSTestingStartTime has passed) and, when a sampling rate is set,
+ * of one in every N admissions in production. Every admitting thread claims
+ * and allocates its own fixed size ring buffer on its first record and is
+ * the only writer to it, so recording is a couple of atomic loads and
+ * stores, and nothing is allocated unless sampling or a TPS test is on.
+ * Records that find their ring full, or come from a thread beyond the last
+ * ring, are dropped and counted. Timestamps come from a monotonic clock and
+ * are only converted to wall clock time when drained.
+ *
+ * Draining also moves the arrivals of a TPS test into
+ * vecTPSTestReceivedTimesMempool, which admission used to fill itself.
+ */
+class CAdmissionRecorder
+{
+public:
+    /** Threads beyond this many record nothing, which is logged once */
+    static constexpr int MAX_RINGS = 32;
+
+    void Start(size_t nCapacity, int nSampleRate);
+    /** Return whether an admission starting now is to be recorded */
+    bool ShouldRecord();
+    static int64_t NowMicros();
+    void Record(const uint256& txid, int64_t nArrivalMicros, AdmissionOutcome outcome);
+    /** Move every record into vRecords */
+    void Drain(std::vector<AdmissionRecord>& vRecords);
+    /** Publish the TPS test arrivals, keeping the records for the next Drain */
+    void CollectTPSTestArrivals();
+    AdmissionRecorderStats GetStats() const;
+    size_t DynamicMemoryUsage() const;
+
+private:
+    struct Entry {
+        uint256 m_txid;
+        int64_t m_time;
+        AdmissionOutcome m_outcome;
+    };
+    struct Ring {
+        std::unique_ptr<Entry[]> m_entries;
+        // written by the owning thread only
+        std::atomic<uint64_t> m_head{0};
+        // written by the drainer only
+        std::atomic<uint64_t> m_tail{0};
+    };
+
+    Ring* ClaimRing();
+    // Move the rings into m_drained, appending the TPS test arrivals to vArrivals
+    void DrainRings(std::vector<AdmissionRecord>& vArrivals) EXCLUSIVE_LOCKS_REQUIRED(m_drain_mutex);
+    static void PublishTPSTestArrivals(const std::vector<AdmissionRecord>& vArrivals) LOCKS_EXCLUDED(cs_main);
+
+    Mutex m_drain_mutex;
+    // drained from the rings but not returned by Drain yet, at most one
+    // ring's worth per ring; the oldest are dropped beyond that
+    std::deque<AdmissionRecord> m_drained GUARDED_BY(m_drain_mutex);
+    Ring m_rings[MAX_RINGS];
+    size_t m_capacity{0};
+    std::atomic<int> m_allocated_rings{0};
+    std::atomic<bool> m_started{false};
+    std::atomic<int> m_next_ring{0};
+    std::atomic<int> m_sample_rate{0};
+    // wall clock minus monotonic clock, in microseconds
+    std::atomic<int64_t> m_wall_offset{0};
+    std::atomic<uint64_t> m_recorded{0};
+    std::atomic<uint64_t> m_dropped{0};
+};
+
+CAdmissionRecorder g_admission_recorder;
+
+void CAdmissionRecorder::Start(size_t nCapacity, int nSampleRate)
+{
+    LOCK(m_drain_mutex);
+    m_wall_offset = GetTimeMicros() - NowMicros();
+    m_sample_rate = std::max(0, nSampleRate);
+    // threads allocate their ring with this capacity and keep it, so it is
+    // set once
+    if (m_started) return;
+    m_capacity = std::max<size_t>(1, nCapacity);
+    m_started.store(true, std::memory_order_release);
+}
+
+int64_t CAdmissionRecorder::NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool CAdmissionRecorder::ShouldRecord()
+{
+    if (!m_started.load(std::memory_order_acquire)) return false;
+    if (nTPSTestingStartTime > 0 && NowMicros() + m_wall_offset.load(std::memory_order_relaxed) >= nTPSTestingStartTime)
+        return true;
+    const int nSampleRate = m_sample_rate.load(std::memory_order_relaxed);
+    if (nSampleRate <= 0) return false;
+    static thread_local uint64_t nAdmissions = 0;
+    return ++nAdmissions % nSampleRate == 0;
+}
+
+CAdmissionRecorder::Ring* CAdmissionRecorder::ClaimRing()
+{
+    static thread_local Ring* pring = nullptr;
+    static thread_local bool fClaimed = false;
+    if (!fClaimed) {
+        fClaimed = true;
+        const int nRing = m_next_ring.fetch_add(1, std::memory_order_relaxed);
+        if (nRing < MAX_RINGS) {
+            // published to the drainer by the release store of m_head
+            pring = &m_rings[nRing];
+            pring->m_entries.reset(new Entry[m_capacity]);
+            m_allocated_rings.fetch_add(1, std::memory_order_relaxed);
+        } else if (nRing == MAX_RINGS) {
+            LogPrintf("Admission recorder: more than %d threads admit transactions, the arrivals of the others are not recorded\n", MAX_RINGS);
+        }
+    }
+    return pring;
+}
+
+void CAdmissionRecorder::Record(const uint256& txid, int64_t nArrivalMicros, AdmissionOutcome outcome)
+{
+    Ring* ring = ClaimRing();
+    if (!ring) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const uint64_t nHead = ring->m_head.load(std::memory_order_relaxed);
+    if (nHead - ring->m_tail.load(std::memory_order_acquire) >= m_capacity) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Entry& entry = ring->m_entries[nHead % m_capacity];
+    entry.m_txid = txid;
+    entry.m_time = nArrivalMicros;
+    entry.m_outcome = outcome;
+    ring->m_head.store(nHead + 1, std::memory_order_release);
+    m_recorded.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CAdmissionRecorder::DrainRings(std::vector<AdmissionRecord>& vArrivals)
+{
+    const int64_t nWallOffset = m_wall_offset;
+    const int nRings = std::min<int>(m_next_ring.load(std::memory_order_relaxed), MAX_RINGS);
+    const size_t nFirst = m_drained.size();
+    for (int i = 0; i < nRings; i++) {
+        Ring& ring = m_rings[i];
+        const uint64_t nHead = ring.m_head.load(std::memory_order_acquire);
+        uint64_t nTail = ring.m_tail.load(std::memory_order_relaxed);
+        for (; nTail != nHead; nTail++) {
+            const Entry& entry = ring.m_entries[nTail % m_capacity];
+            m_drained.push_back(AdmissionRecord{entry.m_txid, entry.m_time + nWallOffset, entry.m_outcome});
+        }
+        ring.m_tail.store(nTail, std::memory_order_release);
+    }
+    if (nTPSTestingStartTime > 0 && m_drained.size() > nFirst) {
+        // admissions that were never processed did not reach PreChecks,
+        // which is where the TPS test used to take its arrivals
+        for (auto it = m_drained.begin() + nFirst; it != m_drained.end(); ++it) {
+            if (it->m_time_micros >= nTPSTestingStartTime && it->m_outcome != AdmissionOutcome::NOT_PROCESSED)
+                vArrivals.push_back(*it);
+        }
+    }
+    const size_t nMaxDrained = MAX_RINGS * m_capacity;
+    if (m_drained.size() > nMaxDrained) {
+        m_dropped.fetch_add(m_drained.size() - nMaxDrained, std::memory_order_relaxed);
+        m_drained.erase(m_drained.begin(), m_drained.end() - nMaxDrained);
+    }
+}
+
+void CAdmissionRecorder::PublishTPSTestArrivals(const std::vector<AdmissionRecord>& vArrivals)
+{
+    if (vArrivals.empty()) return;
+    // admission takes m_drain_mutex under cs_main, so this waits until it is released
+    LOCK(cs_main);
+    for (const AdmissionRecord& record : vArrivals) {
+        vecTPSTestReceivedTimesMempool.emplace_back(record.m_txid, record.m_time_micros);
+    }
+}
+
+void CAdmissionRecorder::Drain(std::vector<AdmissionRecord>& vRecords)
+{
+    std::vector<AdmissionRecord> vArrivals;
+    {
+        LOCK(m_drain_mutex);
+        if (!m_started) return;
+        DrainRings(vArrivals);
+        vRecords.insert(vRecords.end(), m_drained.begin(), m_drained.end());
+        m_drained.clear();
+    }
+    PublishTPSTestArrivals(vArrivals);
+}
+
+void CAdmissionRecorder::CollectTPSTestArrivals()
+{
+    std::vector<AdmissionRecord> vArrivals;
+    {
+        LOCK(m_drain_mutex);
+        if (!m_started) return;
+        DrainRings(vArrivals);
+    }
+    PublishTPSTestArrivals(vArrivals);
+}
+
+AdmissionRecorderStats CAdmissionRecorder::GetStats() const
+{
+    return AdmissionRecorderStats{m_recorded.load(), m_dropped.load(), m_sample_rate.load()};
+}
+
+size_t CAdmissionRecorder::DynamicMemoryUsage() const
+{
+    if (!m_started.load(std::memory_order_acquire)) return 0;
+    return m_allocated_rings.load(std::memory_order_relaxed) * m_capacity * sizeof(Entry);
+}
+
+static AdmissionOutcome GetAdmissionOutcome(bool fAccepted, const TxValidationState& state)
+{
+    if (fAccepted) return AdmissionOutcome::ACCEPTED;
+    if (!state.IsInvalid()) return AdmissionOutcome::NOT_PROCESSED;
+    if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS) return AdmissionOutcome::MISSING_INPUTS;
+    return AdmissionOutcome::REJECTED;
+}
+
+void StartAdmissionRecorder()
+{
+    const int nCapacity = gArgs.GetArg("-admissionrecordsize", DEFAULT_ADMISSION_RECORD_SIZE);
+    g_admission_recorder.Start(std::max(1, nCapacity), gArgs.GetArg("-admissionsamplerate", DEFAULT_ADMISSION_SAMPLE_RATE));
+}
+
+void DrainAdmissionRecords(std::vector<AdmissionRecord>& vRecords)
+{
+    g_admission_recorder.Drain(vRecords);
+}
+
+void CollectTPSTestArrivals()
+{
+    g_admission_recorder.CollectTPSTestArrivals();
+}
+
+AdmissionRecorderStats GetAdmissionRecorderStats()
+{
+    return g_admission_recorder.GetStats();
+}
+
+// SYSCOIN
+/**
+ * Asset allocation double spends waiting to be removed from the mempool.
+ * Admitting threads push into a bounded lock-free ring (Vyukov's bounded
+ * queue with per-cell sequence numbers), so detecting a double spend never
+ * waits on a lock, even while many threads detect them at once. Should the
+ * ring ever fill up, the entry goes to vecToRemoveFromMempool under
+ * cs_assetallocationmempoolremovetx instead, so nothing is lost. The single
+ * consumer moves everything into a map ordered by median time past and only
+ * pops the entries that are due.
+ *
+ * The ring is only used once the consumer has called PopDue for the first
+ * time. Until then every entry goes straight to vecToRemoveFromMempool, which
+ * the removal loop that predates the queue drains on its own.
+ */
+class CZdagRemovalQueue
+{
+public:
+    static constexpr uint64_t CAPACITY = 1 << 14;
+
+    CZdagRemovalQueue();
+
+    void Push(const uint256& txid, int64_t nMedianTimePast);
+    void PopDue(int64_t nMedianTimePast, std::vector<std::pair<uint256, int64_t>>& vDue);
+    ZdagRemovalStats GetStats() const;
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> m_sequence;
+        uint256 m_txid;
+        int64_t m_time;
+    };
+
+    void Collect() EXCLUSIVE_LOCKS_REQUIRED(m_consumer_mutex);
+
+    std::unique_ptr<Cell[]> m_cells;
+    std::atomic<uint64_t> m_enqueue_pos{0};
+    std::atomic<bool> m_consumer_attached{false};
+
+    Mutex m_consumer_mutex;
+    uint64_t m_dequeue_pos GUARDED_BY(m_consumer_mutex){0};
+    std::multimap<int64_t, uint256> m_due GUARDED_BY(m_consumer_mutex);
+
+    std::atomic<uint64_t> m_queued{0};
+    std::atomic<uint64_t> m_overflowed{0};
+    std::atomic<uint64_t> m_processed{0};
+    std::atomic<uint64_t> m_legacy{0};
+};
+
+CZdagRemovalQueue g_zdag_removals;
+
+CZdagRemovalQueue::CZdagRemovalQueue() : m_cells(new Cell[CAPACITY])
+{
+    for (uint64_t i = 0; i < CAPACITY; i++) {
+        m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+void CZdagRemovalQueue::Push(const uint256& txid, int64_t nMedianTimePast)
+{
+    m_queued.fetch_add(1, std::memory_order_relaxed);
+    if (!m_consumer_attached.load(std::memory_order_acquire)) {
+        m_legacy.fetch_add(1, std::memory_order_relaxed);
+        LOCK(cs_assetallocationmempoolremovetx);
+        vecToRemoveFromMempool.emplace_back(txid, nMedianTimePast);
+        return;
+    }
+    uint64_t nPos = m_enqueue_pos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &m_cells[nPos % CAPACITY];
+        const uint64_t nSequence = cell->m_sequence.load(std::memory_order_acquire);
+        const int64_t nDiff = (int64_t)(nSequence - nPos);
+        if (nDiff == 0) {
+            // the cell is free for position nPos, claim it
+            if (m_enqueue_pos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed)) break;
+        } else if (nDiff < 0) {
+            // the consumer has not freed the cell yet: the ring is full
+            m_overflowed.fetch_add(1, std::memory_order_relaxed);
+            LOCK(cs_assetallocationmempoolremovetx);
+            vecToRemoveFromMempool.emplace_back(txid, nMedianTimePast);
+            return;
+        } else {
+            nPos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->m_txid = txid;
+    cell->m_time = nMedianTimePast;
+    cell->m_sequence.store(nPos + 1, std::memory_order_release);
+}
+
+void CZdagRemovalQueue::Collect()
+{
+    while (true) {
+        Cell& cell = m_cells[m_dequeue_pos % CAPACITY];
+        const uint64_t nSequence = cell.m_sequence.load(std::memory_order_acquire);
+        // not published yet (or never pushed): everything before it is collected
+        if (nSequence != m_dequeue_pos + 1) break;
+        m_due.emplace(cell.m_time, cell.m_txid);
+        cell.m_sequence.store(m_dequeue_pos + CAPACITY, std::memory_order_release);
+        m_dequeue_pos++;
+    }
+    LOCK(cs_assetallocationmempoolremovetx);
+    for (const auto& overflow : vecToRemoveFromMempool) {
+        m_due.emplace(overflow.second, overflow.first);
+    }
+    vecToRemoveFromMempool.clear();
+}
+
+void CZdagRemovalQueue::PopDue(int64_t nMedianTimePast, std::vector<std::pair<uint256, int64_t>>& vDue)
+{
+    LOCK(m_consumer_mutex);
+    m_consumer_attached.store(true, std::memory_order_release);
+    Collect();
+    const auto itEnd = m_due.upper_bound(nMedianTimePast);
+    for (auto it = m_due.begin(); it != itEnd; ++it) {
+        vDue.emplace_back(it->second, it->first);
+    }
+    m_processed.fetch_add(std::distance(m_due.begin(), itEnd), std::memory_order_relaxed);
+    m_due.erase(m_due.begin(), itEnd);
+}
+
+ZdagRemovalStats CZdagRemovalQueue::GetStats() const
+{
+    ZdagRemovalStats stats;
+    stats.m_queued = m_queued.load();
+    stats.m_overflowed = m_overflowed.load();
+    stats.m_processed = m_processed.load();
+    stats.m_legacy = m_legacy.load();
+    const uint64_t nDone = stats.m_processed + stats.m_legacy;
+    stats.m_pending = stats.m_queued - std::min(stats.m_queued, nDone);
+    return stats;
+}
+
+void PopDueZdagRemovals(int64_t nMedianTimePast, std::vector<std::pair<uint256, int64_t>>& vDue)
+{
+    g_zdag_removals.PopDue(nMedianTimePast, vDue);
+}
+
+ZdagRemovalStats GetZdagRemovalStats()
+{
+    return g_zdag_removals.GetStats();
+}
+
+/** Maximum number of mempool script checking threads allowed */
+static const int MAX_MEMPOOL_SCRIPTCHECK_THREADS = 64;
+/** -mempoolscriptthreads default (number of mempool script verification threads, 0 = disabled) */
+static const int DEFAULT_MEMPOOL_SCRIPTCHECK_THREADS = 0;
+/** -mempoolparallelinputs default (inputs of one transaction above which its scripts are verified in parallel) */
+static const int DEFAULT_MEMPOOL_PARALLEL_INPUTS = 64;
+/** Fewest inputs worth a job of their own when splitting one transaction */
+static const size_t MIN_MEMPOOL_INPUTS_PER_JOB = 16;
+
+/**
+ * Pool of threads verifying the policy script checks of transactions being
+ * accepted by MemPoolAccept::AcceptTransactionsParallel. Unlike the block
+ * check queue every job reports its own result, since one invalid transaction
+ * must not fail the others. Started with -mempoolscriptthreads; while no
+ * threads are running the calling thread verifies every job itself.
+ * The inputs of a single transaction with at least -mempoolparallelinputs
+ * inputs are split over several jobs too.
+ */
+class CMempoolScriptCheckPool
+{
+public:
+    struct Job {
+        std::vector<CScriptCheck> m_checks;
+        ScriptError m_error{SCRIPT_ERR_UNKNOWN_ERROR};
+        size_t m_passed{0}; //!< checks that passed before the first failure
+        bool m_result{false};
+        bool m_done{false};
+        int64_t m_micros{0};
+    };
+
+    ~CMempoolScriptCheckPool() { Stop(); }
+
+    void Start(int nThreads, int nParallelInputs);
+    void Stop();
+    size_t GetThreadCount() const { return m_threads.size(); }
+
+    // Number of jobs the script checks of nInputs inputs of one transaction
+    // are split into, 1 if the calling thread should verify them alone.
+    size_t GetInputJobCount(size_t nInputs) const
+    {
+        if (m_threads.empty() || nInputs < m_parallel_inputs) return 1;
+        return std::max<size_t>(1, std::min(m_threads.size() + 1, nInputs / MIN_MEMPOOL_INPUTS_PER_JOB));
+    }
+
+    // Verify all jobs which are not done yet. The calling thread takes part
+    // in the verification and returns once every job has a result.
+    void Run(std::vector<Job>& jobs);
+
+private:
+    static void Verify(Job& job);
+    void ThreadLoop();
+
+    Mutex m_mutex;
+    std::condition_variable m_cond_work;
+    std::condition_variable m_cond_done;
+    std::deque<Job*> m_queue GUARDED_BY(m_mutex);
+    size_t m_pending GUARDED_BY(m_mutex){0};
+    bool m_request_stop GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_threads;
+    size_t m_parallel_inputs{0};
+};
+
+CMempoolScriptCheckPool g_mempool_script_check_pool;
+
+void CMempoolScriptCheckPool::Start(int nThreads, int nParallelInputs)
+{
+    if (!m_threads.empty()) return;
+    m_parallel_inputs = std::max(1, nParallelInputs);
+    {
+        LOCK(m_mutex);
+        m_request_stop = false;
+    }
+    for (int i = 0; i < nThreads; i++) {
+        m_threads.emplace_back(&TraceThread<std::function<void()> >, "mempoolscript", std::function<void()>(std::bind(&CMempoolScriptCheckPool::ThreadLoop, this)));
+    }
+    LogPrintf("Using %d threads for mempool script verification\n", nThreads);
+}
+
+void CMempoolScriptCheckPool::Stop()
+{
+    {
+        LOCK(m_mutex);
+        m_request_stop = true;
+    }
+    m_cond_work.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+void CMempoolScriptCheckPool::Verify(Job& job)
+{
+    const int64_t nStart = GetTimeMicros();
+    job.m_result = true;
+    for (CScriptCheck& check : job.m_checks) {
+        if (!check()) {
+            job.m_error = check.GetScriptError();
+            job.m_result = false;
+            break;
+        }
+        job.m_passed++;
+    }
+    job.m_micros = GetTimeMicros() - nStart;
+}
+
+void CMempoolScriptCheckPool::Run(std::vector<Job>& jobs)
+{
+    if (m_threads.empty()) {
+        for (Job& job : jobs) {
+            if (!job.m_done) Verify(job);
+        }
+        return;
+    }
+    {
+        LOCK(m_mutex);
+        for (Job& job : jobs) {
+            if (job.m_done) continue;
+            m_queue.push_back(&job);
+            m_pending++;
+        }
+    }
+    m_cond_work.notify_all();
+    while (true) {
+        Job* job;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            if (m_queue.empty()) {
+                m_cond_done.wait(lock, [&]{ return m_pending == 0; });
+                return;
+            }
+            job = m_queue.front();
+            m_queue.pop_front();
+        }
+        Verify(*job);
+        bool fAllDone;
+        {
+            LOCK(m_mutex);
+            job->m_done = true;
+            fAllDone = --m_pending == 0;
+        }
+        // another caller may be waiting for the jobs to drain
+        if (fAllDone) m_cond_done.notify_all();
+    }
+}
+
+void CMempoolScriptCheckPool::ThreadLoop()
+{
+    while (true) {
+        Job* job;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond_work.wait(lock, [&]{ return m_request_stop || !m_queue.empty(); });
+            if (m_request_stop) return;
+            job = m_queue.front();
+            m_queue.pop_front();
+        }
+        Verify(*job);
+        bool fAllDone;
+        {
+            LOCK(m_mutex);
+            job->m_done = true;
+            fAllDone = --m_pending == 0;
+        }
+        if (fAllDone) m_cond_done.notify_all();
+    }
+}
+
+void StartMempoolScriptCheckThreads()
+{
+    // 0 disables the threads, a negative value leaves that many cores free
+    int nThreads = gArgs.GetArg("-mempoolscriptthreads", DEFAULT_MEMPOOL_SCRIPTCHECK_THREADS);
+    if (nThreads < 0)
+        nThreads += GetNumCores();
+    nThreads = std::max(0, std::min(nThreads, MAX_MEMPOOL_SCRIPTCHECK_THREADS));
+    if (nThreads > 0)
+        g_mempool_script_check_pool.Start(nThreads, gArgs.GetArg("-mempoolparallelinputs", DEFAULT_MEMPOOL_PARALLEL_INPUTS));
+}
+
+void StopMempoolScriptCheckThreads()
+{
+    g_mempool_script_check_pool.Stop();
+}
+
+int GetMempoolScriptCheckThreadCount()
+{
+    return g_mempool_script_check_pool.GetThreadCount();
+}
+
+/** How often the idle state flush thread checks whether shutdown was requested */
+static constexpr std::chrono::seconds STATE_FLUSH_INTERVAL{10};
+
+/**
+ * Thread running the periodic FlushStateToDisk on behalf of mempool admission.
+ * Admission only compares the coins cache usage against a watermark and
+ * signals the thread, which coalesces all requests that arrive while it is
+ * busy into one flush. Only when the cache overshoots its limit does
+ * admission fall back to flushing inline.
+ *
+ * FlushStateToDisk needs cs_main for the whole write, so an admission
+ * arriving during a flush still waits for it; what moves off the admission
+ * path is the decision and the wait of the admission that triggered it.
+ */
+class CStateFlusher
+{
+public:
+    /** Percentage of the coins cache limit at which a flush is requested */
+    static constexpr size_t HIGH_WATERMARK_PERCENT = 90;
+
+    using Stats = StateFlushStats;
+
+    ~CStateFlusher() { Stop(); }
+
+    void Start();
+    void Stop();
+
+    void RequestFlushIfNeeded(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    Stats GetStats() const;
+
+private:
+    void ThreadLoop();
+    void Flush(const CChainParams& chainparams, bool fInline);
+
+    mutable Mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_flush_requested GUARDED_BY(m_mutex){false};
+    bool m_request_stop GUARDED_BY(m_mutex){false};
+    Stats m_stats GUARDED_BY(m_mutex);
+    std::thread m_thread;
+};
+
+CStateFlusher g_state_flusher;
+
+void CStateFlusher::Start()
+{
+    if (m_thread.joinable()) return;
+    {
+        LOCK(m_mutex);
+        m_request_stop = false;
+    }
+    m_thread = std::thread(&TraceThread<std::function<void()> >, "stateflush", std::function<void()>(std::bind(&CStateFlusher::ThreadLoop, this)));
+}
+
+void CStateFlusher::Stop()
+{
+    {
+        LOCK(m_mutex);
+        m_request_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void CStateFlusher::RequestFlushIfNeeded(const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    const size_t nCacheUsage = ::ChainstateActive().CoinsTip().DynamicMemoryUsage();
+    if (!m_thread.joinable() || nCacheUsage > nCoinCacheUsage) {
+        // No flusher, or it could not keep up: bound the cache ourselves.
+        Flush(chainparams, true);
+        return;
+    }
+    if (nCacheUsage * 100 < nCoinCacheUsage * HIGH_WATERMARK_PERCENT) return;
+    {
+        LOCK(m_mutex);
+        m_stats.m_requests++;
+        if (m_flush_requested) return;
+        m_flush_requested = true;
+    }
+    m_cond.notify_one();
+}
+
+CStateFlusher::Stats CStateFlusher::GetStats() const
+{
+    LOCK(m_mutex);
+    Stats stats = m_stats;
+    stats.m_running = m_thread.joinable() && !m_request_stop;
+    return stats;
+}
+
+void CStateFlusher::Flush(const CChainParams& chainparams, bool fInline)
+{
+    BlockValidationState state_dummy;
+    const int64_t nStart = GetTimeMicros();
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
+    const int64_t nElapsed = GetTimeMicros() - nStart;
+    LOCK(m_mutex);
+    if (fInline) m_stats.m_inline_flushes++; else m_stats.m_flushes++;
+    m_stats.m_last_micros = nElapsed;
+    m_stats.m_max_micros = std::max(m_stats.m_max_micros, nElapsed);
+    m_stats.m_total_micros += nElapsed;
+    LogPrint(BCLog::BENCH, "    - State flush%s: %.2fms [%u requests, %u flushes, %u inline, max %.2fms, total %.2fs]\n",
+        fInline ? " (inline)" : "", nElapsed * MILLI, m_stats.m_requests, m_stats.m_flushes, m_stats.m_inline_flushes,
+        m_stats.m_max_micros * MILLI, m_stats.m_total_micros * MICRO);
+}
+
+void CStateFlusher::ThreadLoop()
+{
+    while (true) {
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond.wait_for(lock, STATE_FLUSH_INTERVAL, [&]{ return m_request_stop || m_flush_requested; });
+            if (m_request_stop) return;
+            if (!m_flush_requested) {
+                // Shutdown flushes and tears down the chainstate itself, so
+                // stop before it does even if nobody called Stop().
+                if (ShutdownRequested()) return;
+                continue;
+            }
+            // Every request that came in up to here is served by this flush.
+            m_flush_requested = false;
+        }
+        LOCK(cs_main);
+        if (ShutdownRequested()) return;
+        Flush(Params(), false);
+    }
+}
+
+void StartStateFlushThread()
+{
+    g_state_flusher.Start();
+}
+
+void StopStateFlushThread()
+{
+    g_state_flusher.Stop();
+}
+
+StateFlushStats GetStateFlushStats()
+{
+    return g_state_flusher.GetStats();
+}
+
+/**
+ * Conflict domains of mempool admission. Every admission locks the partitions
+ * of the outpoint hashes it spends and, for asset allocations, of its sender
+ * tuple, so admissions of transactions that could conflict with each other are
+ * serialized while disjoint ones proceed concurrently. Transactions touching
+ * too many partitions take the global lock exclusively instead, which all
+ * other admissions hold shared. Partitions are always locked in ascending
+ * order after the global lock, so the scheme cannot deadlock.
+ *
+ * Lock order: cs_main, then the partitions, then m_pool.cs. Code that
+ * already holds m_pool.cs (UpdateMempoolForReorg) must not take partitions.
+ * It does not need them either: it keeps every other admission away from
+ * the mempool for as long as it runs, and an admission holding partitions
+ * across that redoes its PreChecks once it sees the mempool changed.
+ */
+class CAdmissionPartitions
+{
+public:
+    static constexpr size_t NUM_PARTITIONS = 256;
+    /** Above this many distinct partitions an admission falls back to the global lock */
+    static constexpr size_t MAX_PARTITIONS_PER_ADMISSION = 16;
+
+    boost::shared_mutex m_global;
+    std::mutex m_partitions[NUM_PARTITIONS];
+};
+
+CAdmissionPartitions g_admission_partitions;
+
+/** RAII lock on the admission partitions of a set of partition keys */
+class CAdmissionPartitionGuard
+{
+public:
+    CAdmissionPartitionGuard(CAdmissionPartitions& partitions, const std::vector<uint64_t>& vKeys)
+    {
+        std::vector<size_t> vIndex;
+        vIndex.reserve(vKeys.size());
+        for (const uint64_t nKey : vKeys) {
+            vIndex.push_back(nKey % CAdmissionPartitions::NUM_PARTITIONS);
+        }
+        std::sort(vIndex.begin(), vIndex.end());
+        vIndex.erase(std::unique(vIndex.begin(), vIndex.end()), vIndex.end());
+        if (vIndex.size() > CAdmissionPartitions::MAX_PARTITIONS_PER_ADMISSION) {
+            m_exclusive = boost::unique_lock<boost::shared_mutex>(partitions.m_global);
+            return;
+        }
+        m_shared = boost::shared_lock<boost::shared_mutex>(partitions.m_global);
+        m_locks.reserve(vIndex.size());
+        for (const size_t nIndex : vIndex) {
+            m_locks.emplace_back(partitions.m_partitions[nIndex]);
+        }
+    }
+
+private:
+    boost::unique_lock<boost::shared_mutex> m_exclusive;
+    boost::shared_lock<boost::shared_mutex> m_shared;
+    std::vector<std::unique_lock<std::mutex>> m_locks;
+};
+
+/** Append the admission partition keys of tx to vKeys */
+static void GetAdmissionPartitionKeys(const CTransaction& tx, std::vector<uint64_t>& vKeys)
+{
+    for (const CTxIn& txin : tx.vin) {
+        vKeys.push_back(txin.prevout.hash.GetCheapHash());
+    }
+    // SYSCOIN
+    if (IsAssetAllocationTx(tx.nVersion)) {
+        CAssetAllocation theAssetAllocation(tx);
+        if (!theAssetAllocation.assetAllocationTuple.IsNull()) {
+            vKeys.push_back((CHashWriter(SER_GETHASH, 0) << theAssetAllocation.assetAllocationTuple).GetCheapHash());
+        }
+    }
+}
+
+/**
+ * Sorted set of a few trivially copyable values kept in a prevector, so the
+ * handful of conflicts or parents an admission usually deals with never
+ * touch the heap.
+ */
+template<unsigned int N, typename T>
+class CSmallFlatSet
+{
+public:
+    typedef typename prevector<N, T>::const_iterator const_iterator;
+
+    bool insert(const T& value)
+    {
+        typename prevector<N, T>::iterator it = std::lower_bound(m_values.begin(), m_values.end(), value);
+        if (it != m_values.end() && *it == value) return false;
+        m_values.insert(it, value);
+        return true;
+    }
+    size_t count(const T& value) const { return std::binary_search(m_values.begin(), m_values.end(), value) ? 1 : 0; }
+    size_t size() const { return m_values.size(); }
+    bool empty() const { return m_values.empty(); }
+    void clear() { m_values.clear(); }
+    const_iterator begin() const { return m_values.begin(); }
+    const_iterator end() const { return m_values.end(); }
+
+private:
+    prevector<N, T> m_values;
+};
+
+/**
+ * Recycles the storage of the CTxMemPoolEntry every admission builds in its
+ * Workspace (the mempool copies it on insertion). Workspaces never leave the
+ * thread that made them, so every thread keeps its own free list and no lock
+ * is taken; rejected transactions then cost no allocation for their entry.
+ */
+class CMempoolEntrySlab
+{
+public:
+    /** Blocks kept per thread; more are returned to the heap */
+    static constexpr size_t MAX_FREE_PER_THREAD = 64;
+
+    static void* Allocate();
+    static void Free(void* p);
+    static AdmissionMemoryStats GetStats();
+
+private:
+    struct FreeList {
+        std::vector<void*> m_blocks;
+        ~FreeList();
+    };
+    static FreeList& GetFreeList();
+
+    static std::atomic<uint64_t> g_allocs;
+    static std::atomic<uint64_t> g_reuses;
+    static std::atomic<uint64_t> g_cached_bytes;
+};
+
+std::atomic<uint64_t> CMempoolEntrySlab::g_allocs{0};
+std::atomic<uint64_t> CMempoolEntrySlab::g_reuses{0};
+std::atomic<uint64_t> CMempoolEntrySlab::g_cached_bytes{0};
+
+CMempoolEntrySlab::FreeList::~FreeList()
+{
+    for (void* p : m_blocks) {
+        ::operator delete(p);
+    }
+    g_cached_bytes.fetch_sub(m_blocks.size() * sizeof(CTxMemPoolEntry), std::memory_order_relaxed);
+}
+
+CMempoolEntrySlab::FreeList& CMempoolEntrySlab::GetFreeList()
+{
+    static thread_local FreeList freelist;
+    return freelist;
+}
+
+void* CMempoolEntrySlab::Allocate()
+{
+    FreeList& freelist = GetFreeList();
+    if (freelist.m_blocks.empty()) {
+        g_allocs.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(sizeof(CTxMemPoolEntry));
+    }
+    void* p = freelist.m_blocks.back();
+    freelist.m_blocks.pop_back();
+    g_reuses.fetch_add(1, std::memory_order_relaxed);
+    g_cached_bytes.fetch_sub(sizeof(CTxMemPoolEntry), std::memory_order_relaxed);
+    return p;
+}
+
+void CMempoolEntrySlab::Free(void* p)
+{
+    FreeList& freelist = GetFreeList();
+    if (freelist.m_blocks.size() >= MAX_FREE_PER_THREAD) {
+        ::operator delete(p);
+        return;
+    }
+    if (freelist.m_blocks.capacity() == 0) freelist.m_blocks.reserve(MAX_FREE_PER_THREAD);
+    freelist.m_blocks.push_back(p);
+    g_cached_bytes.fetch_add(sizeof(CTxMemPoolEntry), std::memory_order_relaxed);
+}
+
+AdmissionMemoryStats CMempoolEntrySlab::GetStats()
+{
+    return AdmissionMemoryStats{g_allocs.load(), g_reuses.load(), g_cached_bytes.load(), 0};
+}
+
+struct CMempoolEntryDeleter {
+    void operator()(CTxMemPoolEntry* entry) const
+    {
+        entry->~CTxMemPoolEntry();
+        CMempoolEntrySlab::Free(entry);
+    }
+};
+typedef std::unique_ptr<CTxMemPoolEntry, CMempoolEntryDeleter> CMempoolEntryPtr;
+
+template<typename... Args>
+CMempoolEntryPtr MakeMempoolEntry(Args&&... args)
+{
+    void* p = CMempoolEntrySlab::Allocate();
+    try {
+        return CMempoolEntryPtr(new (p) CTxMemPoolEntry(std::forward<Args>(args)...));
+    } catch (...) {
+        CMempoolEntrySlab::Free(p);
+        throw;
+    }
+}
+
+AdmissionMemoryStats GetAdmissionMemoryStats()
+{
+    AdmissionMemoryStats stats = CMempoolEntrySlab::GetStats();
+    stats.m_recorder_bytes = g_admission_recorder.DynamicMemoryUsage();
+    return stats;
+}
 
-    // Check again against the current block tip's script verification
-    // flags to cache our script execution flags. This is, of course,
-    // useless if the next block has different script flags from the
-    // previous one, but because the cache tracks script flags for us it
-    // will auto-invalidate and we'll just have a few blocks of extra
-    // misses on soft-fork activation.
-    //
-    // This is also useful in case of bugs in the standard flags that cause
-    // transactions to pass as valid when they're actually invalid. For
-    // instance the STRICTENC flag was incorrectly allowing certain
-    // CHECKSIG NOT scripts to pass, even though they were invalid.
-    //
-    // There is a similar check in CreateNewBlock() to prevent creating
-    // invalid blocks (using TestBlockValidity), however allowing such
-    // transactions into the mempool can be exploited as a DoS attack.
-    unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(::ChainActive().Tip(), chainparams.GetConsensus());
-    if (!CheckInputsFromMempoolAndCache(tx, state, m_view, m_pool, currentBlockScriptVerifyFlags, txdata)) {
-        return error("%s: BUG! PLEASE REPORT THIS! CheckInputScripts failed against latest-block but not STANDARD flags %s, %s",
-                __func__, hash.ToString(), FormatStateMessage(state));
+/**
+ * Script check outcome of every input of a transaction being admitted, so a
+ * later pass (the consensus one, or a diagnostic rerun) only verifies what an
+ * earlier one did not cover. Script verification flags only ever add
+ * restrictions, so an input that passed with some flags passes with any
+ * subset of them.
+ */
+class CInputScriptResults
+{
+public:
+    void Init(size_t nInputs)
+    {
+        if (m_inputs.size() != nInputs) m_inputs.assign(nInputs, Result());
     }
-    // SYSCOIN
-    if (IsSyscoinTx(tx.nVersion) && !CheckSyscoinInputs(tx, hash, state, m_view, true, ::ChainActive().Height(), ::ChainActive().Tip()->GetMedianTimePast(), args.m_test_accept || args.m_bypass_limits)) {
-        // mark to remove from mempool, because if we remove right away then the transaction data cannot be relayed most of the time
-        if(!args.m_test_accept && state.IsError()){
-            LogPrint(BCLog::SYS, "Double spend detected on tx %s! %s\n", hash.GetHex(), FormatStateMessage(state));
-            LOCK(cs_assetallocationmempoolremovetx);
-            vecToRemoveFromMempool.emplace_back(hash, ::ChainActive().Tip()->GetMedianTimePast());
+    bool IsCovered(size_t nIn, unsigned int flags) const
+    {
+        return m_inputs[nIn].m_passed && (flags & ~m_inputs[nIn].m_passed_flags) == 0;
+    }
+    bool IsCovered(unsigned int flags) const
+    {
+        if (m_inputs.empty()) return false;
+        for (size_t i = 0; i < m_inputs.size(); i++) {
+            if (!IsCovered(i, flags)) return false;
+        }
+        return true;
+    }
+    void Set(size_t nIn, unsigned int flags, bool fPassed)
+    {
+        Result& result = m_inputs[nIn];
+        // a failure with flags says nothing about other flags, and an
+        // input is not verified again with flags it passed with
+        if (!fPassed) return;
+        if (!result.m_passed || (flags & result.m_passed_flags) == result.m_passed_flags) {
+            // keep the widest flags the input passed with
+            result.m_passed = true;
+            result.m_passed_flags = flags;
+        }
+    }
+    void SetAllPassed(unsigned int flags)
+    {
+        for (size_t i = 0; i < m_inputs.size(); i++) {
+            Set(i, flags, true);
         }
-        else
-            return false;
-    }else if(args.m_duplicate){
-        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
     }
-    return true;
-}
 
+private:
+    struct Result {
+        unsigned int m_passed_flags{0};
+        bool m_passed{false};
+    };
+    std::vector<Result> m_inputs;
+};
 
+/** Transactions remembered by the test accept cache */
+static const size_t TEST_ACCEPT_CACHE_SIZE = 1000;
+/** How long a test accept is remembered for */
+static constexpr int64_t TEST_ACCEPT_CACHE_EXPIRY = 60;
 
 /**
+ * Script results of the transactions that recently passed a test accept
+ * (testmempoolaccept), so that submitting one of them for real right after
+ * does not verify its scripts again. An entry is only used on the tip it was
+ * made on, at most once, and within TEST_ACCEPT_CACHE_EXPIRY seconds.
+ */
+class CTestAcceptCache
+{
+public:
+    void Add(const uint256& tip_hash, const uint256& wtxid, const CInputScriptResults& results);
+    /** Move the script results of wtxid into results if it passed a test accept on tip_hash */
+    bool Take(const uint256& tip_hash, const uint256& wtxid, CInputScriptResults& results);
+    TestAcceptCacheStats GetStats() const;
 
-	part 2
-	Accept Transaction in MemPool 
+private:
+    struct Entry {
+        uint256 m_tip_hash;
+        int64_t m_time;
+        CInputScriptResults m_results;
+    };
 
-**/
+    Mutex m_mutex;
+    std::unordered_map<uint256, Entry, SaltedTxidHasher> m_entries GUARDED_BY(m_mutex);
+    // Entries oldest first, for expiry and eviction. Taken entries are only
+    // dropped from here once they reach the front.
+    std::deque<std::pair<uint256, int64_t>> m_order GUARDED_BY(m_mutex);
+    std::atomic<uint64_t> m_inserts{0};
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_stale{0};
+};
 
-bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args)
+CTestAcceptCache g_test_accept_cache;
+
+void CTestAcceptCache::Add(const uint256& tip_hash, const uint256& wtxid, const CInputScriptResults& results)
 {
-    AssertLockHeld(cs_main);
-	
-    LOCK(m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+    const int64_t nNow = GetTime();
+    LOCK(m_mutex);
+    while (!m_order.empty() && (m_entries.size() >= TEST_ACCEPT_CACHE_SIZE || m_order.size() >= 2 * TEST_ACCEPT_CACHE_SIZE ||
+            m_order.front().second + TEST_ACCEPT_CACHE_EXPIRY < nNow)) {
+        auto it = m_entries.find(m_order.front().first);
+        if (it != m_entries.end() && it->second.m_time == m_order.front().second) {
+            m_entries.erase(it);
+        }
+        m_order.pop_front();
+    }
+    Entry& entry = m_entries[wtxid];
+    entry.m_tip_hash = tip_hash;
+    entry.m_time = nNow;
+    entry.m_results = results;
+    m_order.emplace_back(wtxid, nNow);
+    ++m_inserts;
+}
 
-    Workspace workspace(ptx);
-    if (!PreChecks(args, workspace)) return false;
-    // Only compute the precomputed transaction data if we need to verify
-    // scripts (ie, other policy checks pass). We perform the inexpensive
-    // checks first and avoid hashing and signature verification unless those
-    // checks pass, to mitigate CPU exhaustion denial-of-service attacks.
-    PrecomputedTransactionData txdata(*ptx);
-	// Because script checks take little time, we focus on the PreChecks
-	// Check the condition of the mempool, if it is resource conflicted, unlock the mempool
-	bool isConflicted = detectMempool(m_pool);
-	if(isConflicted) UNLOCK(m_pool.cs);
-    if (!PolicyScriptChecks(args, workspace, txdata)) return false;
-    if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
-    // Tx was accepted, but not added
-    if (args.m_test_accept) return true;
-    if (!Finalize(args, workspace)) return false;
-    GetMainSignals().TransactionAddedToMempool(ptx);
-    return true;
+bool CTestAcceptCache::Take(const uint256& tip_hash, const uint256& wtxid, CInputScriptResults& results)
+{
+    LOCK(m_mutex);
+    auto it = m_entries.find(wtxid);
+    if (it == m_entries.end()) return false;
+    const bool fValid = it->second.m_tip_hash == tip_hash && it->second.m_time + TEST_ACCEPT_CACHE_EXPIRY >= GetTime();
+    if (fValid) results = std::move(it->second.m_results);
+    m_entries.erase(it);
+    if (fValid) {
+        ++m_hits;
+    } else {
+        ++m_stale;
+    }
+    return fValid;
 }
 
-} // anon namespace
+TestAcceptCacheStats CTestAcceptCache::GetStats() const
+{
+    return TestAcceptCacheStats{m_inserts.load(), m_hits.load(), m_stale.load()};
+}
 
-/** (try to) add transaction to memory pool with a specified acceptance time **/
-static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
-                        int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+TestAcceptCacheStats GetTestAcceptCacheStats()
 {
-    std::vector<COutPoint> coins_to_uncache;
-    // SYSCOIN
-    bool bDuplicate = false;
-    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept, bDuplicate };
-	
-	// If taskNumber is within a specified range and acceptTime is runnable, we perform accept single transaction
-	int taskNumber = pool.size;
-	int schedulableNumber = isScheduable(pool);
-	int64_t runnableTime = isRunnable(pool,state);
-	bool res = false;
-	if( taskNumber < schedulableNumber && nAcceptTime < runnableTime )
-		res = MemPoolAccept(pool).AcceptSingleTransaction(tx, args);
-    if (!res) {
-        // Remove coins that were not present in the coins cache before calling ATMPW;
-        // this is to prevent memory DoS in case we receive a large number of
-        // invalid transactions that attempt to overrun the in-memory coins cache
-        // (`CCoinsViewCache::cacheCoins`).
+    return g_test_accept_cache.GetStats();
+}
 
-        for (const COutPoint& hashTx : coins_to_uncache)
-            ::ChainstateActive().CoinsTip().Uncache(hashTx);
-    }
-    // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
-    BlockValidationState state_dummy;
-    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
-    return res;
+/**
+ * Ancestor chains of mempool entries, for the common ZDAG case of long chains
+ * of transactions that each spend a single in-mempool parent. The chain of an
+ * entry lists it and its ancestors nearest first, as a persistent list that
+ * shares its tail with the chain of its parent, so each new link costs O(1).
+ * The last link, the root, has no in-mempool parents and is an ancestor of
+ * every other link, so its descendant aggregates bound theirs, while the
+ * ancestor aggregates of the first link are exact: the limits that
+ * CalculateMemPoolAncestors checks are decided without walking the chain.
+ *
+ * Chains are built on demand by following single parents from the nearest
+ * entry that already has one. Entries with several in-mempool parents get
+ * none. Within one tip an entry's parents never change and entries leave the
+ * mempool together with their descendants, so chains stay valid; blocks
+ * confirm roots and reorgs add parents, so all chains are dropped when the
+ * tip changes. Entries leaving the mempool drop their chain through
+ * NotifyEntryRemoved, so the map never outgrows the mempool.
+ */
+class CMempoolAncestorChains
+{
+public:
+    struct Link {
+        uint256 m_hash;
+        std::shared_ptr<const Link> m_parent; //!< null for the root
+        uint256 m_root;
+        uint64_t m_depth; //!< links from here to the root, both included
+    };
+    using LinkPtr = std::shared_ptr<const Link>;
+
+    /**
+     * The chain of the entry it, or null if it or an ancestor has several
+     * in-mempool parents. The first call starts following the removals from pool.
+     */
+    LinkPtr Get(CTxMemPool& pool, CTxMemPool::txiter it, const uint256& tip_hash) EXCLUSIVE_LOCKS_REQUIRED(pool.cs);
+    /** Stop following the mempool and drop every chain */
+    void Stop();
+
+private:
+    void Erase(const uint256& hash);
+
+    Mutex m_mutex;
+    uint256 m_tip_hash GUARDED_BY(m_mutex);
+    std::unordered_map<uint256, LinkPtr, SaltedTxidHasher> m_chains GUARDED_BY(m_mutex);
+    boost::signals2::scoped_connection m_removed_conn;
+};
+
+CMempoolAncestorChains g_mempool_ancestor_chains;
+
+static void StopMempoolAncestorChains()
+{
+    g_mempool_ancestor_chains.Stop();
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
-                        std::list<CTransactionRef>* plTxnReplaced,
-                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept)
+void CMempoolAncestorChains::Erase(const uint256& hash)
 {
-    const CChainParams& chainparams = Params();
-    return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
+    LOCK(m_mutex);
+    m_chains.erase(hash);
 }
 
+void CMempoolAncestorChains::Stop()
+{
+    m_removed_conn.disconnect();
+    LOCK(m_mutex);
+    m_chains.clear();
+}
 
+CMempoolAncestorChains::LinkPtr CMempoolAncestorChains::Get(CTxMemPool& pool, CTxMemPool::txiter it, const uint256& tip_hash)
+{
+    AssertLockHeld(pool.cs);
+    if (!m_removed_conn.connected()) {
+        m_removed_conn = pool.NotifyEntryRemoved.connect([this](CTransactionRef tx, MemPoolRemovalReason) { Erase(tx->GetHash()); });
+    }
+    LOCK(m_mutex);
+    if (m_tip_hash != tip_hash) {
+        m_chains.clear();
+        m_tip_hash = tip_hash;
+    }
+    // Walk up single parents to the nearest entry with a chain, or the root
+    std::vector<CTxMemPool::txiter> vPath;
+    LinkPtr chain;
+    while (true) {
+        const auto found = m_chains.find(it->GetTx().GetHash());
+        if (found != m_chains.end()) {
+            chain = found->second;
+            break;
+        }
+        vPath.push_back(it);
+        const CTxMemPool::setEntries& parents = pool.GetMemPoolParents(it);
+        if (parents.size() > 1) return nullptr;
+        if (parents.empty()) break;
+        it = *parents.begin();
+    }
+    for (auto rit = vPath.rbegin(); rit != vPath.rend(); ++rit) {
+        const uint256& hash = (*rit)->GetTx().GetHash();
+        chain = std::make_shared<const Link>(Link{hash, chain, chain ? chain->m_root : hash, chain ? chain->m_depth + 1 : 1});
+        m_chains.emplace(hash, chain);
+    }
+    return chain;
+}
 
 /**
+ * Most transactions a replacement may evict, BIP125 rule 5. The evictions
+ * are counted from the cached descendant aggregates of the direct conflicts
+ * before any walk, and the walk then visits each evicted entry once, the
+ * same order of work as removing them.
+ */
+static const uint64_t MAX_REPLACEMENT_EVICTIONS = 100;
 
-	part 3
-	main class
-
-**/
 namespace {
 
 class MemPoolAccept
@@ -167,10 +2370,12 @@ class MemPoolAccept
 public:
     // SYSCOIN rearrange m_view and m_pool
     MemPoolAccept(CTxMemPool& mempool) : m_view(&m_dummy), m_pool(mempool), m_viewmempool(&::ChainstateActive().CoinsTip(), m_pool),
-        m_limit_ancestors(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT)),
-        m_limit_ancestor_size(gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000),
-        m_limit_descendants(gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT)),
-        m_limit_descendant_size(gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000) {}
+        m_policy(GetMempoolPolicy()),
+        m_limit_ancestors(m_policy->m_limit_ancestors),
+        m_limit_ancestor_size(m_policy->m_limit_ancestor_size),
+        m_limit_descendants(m_policy->m_limit_descendants),
+        m_limit_descendant_size(m_policy->m_limit_descendant_size),
+        m_tip(GetMempoolTipContext()) {}
 
     // We put the arguments we're handed into a struct, so we can pass them
     // around easier.
@@ -196,6 +2401,18 @@ public:
     
     // Single transaction acceptance
     bool AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    // Acceptance of a set of transactions, in rounds of transactions whose
+    // parents in the set were handled by earlier rounds. PreChecks run under m_pool.cs,
+    // the policy script checks of all transactions that passed them run on
+    // the mempool script check threads without m_pool.cs, and a final commit
+    // step re-takes m_pool.cs, makes sure the inputs are still unspent and
+    // calls Finalize. args[i] belongs to txns[i], results[i] is set if
+    // txns[i] was accepted. Finalize does not limit the mempool size here;
+    // the caller is responsible for doing that once for the whole set.
+    // fPoolLocked is set if the caller holds m_pool.cs throughout, in which
+    // case no admission partitions are taken.
+    void AcceptTransactionsParallel(const std::vector<CTransactionRef>& txns, std::vector<ATMPArgs>& args, std::vector<bool>& results, bool fPoolLocked) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     // SYSCOIN
     CCoinsViewCache m_view;
 private:
@@ -203,10 +2420,13 @@ private:
     // of checking a given transaction.
     struct Workspace {
         Workspace(const CTransactionRef& ptx) : m_ptx(ptx), m_hash(ptx->GetHash()) {}
-        std::set<uint256> m_conflicts;
+        CSmallFlatSet<2, uint256> m_conflicts;
         CTxMemPool::setEntries m_all_conflicting;
         CTxMemPool::setEntries m_ancestors;
-        std::unique_ptr<CTxMemPoolEntry> m_entry;
+        CMempoolEntryPtr m_entry;
+        CInputScriptResults m_script_results;
+        // SYSCOIN inputs this tx double spends (ZDAG), kept as evidence once its scripts pass
+        std::vector<ZdagDoubleSpendEvidence> m_double_spends;
 
         bool m_replacement_transaction;
         CAmount m_modified_fees;
@@ -217,16 +2437,64 @@ private:
         const uint256& m_hash;
     };
 
+    // Look up the mempool entries of the txids in hashes that are in the mempool
+    template<unsigned int N>
+    CTxMemPool::setEntries GetIterSet(const CSmallFlatSet<N, uint256>& hashes) const EXCLUSIVE_LOCKS_REQUIRED(m_pool.cs)
+    {
+        CTxMemPool::setEntries ret;
+        for (const uint256& hash : hashes) {
+            const Optional<CTxMemPool::txiter> mi = m_pool.GetIter(hash);
+            if (mi) ret.insert(*mi);
+        }
+        return ret;
+    }
+
+    // Fill setAncestors from the ancestor chain of parent, the only in-mempool
+    // parent of a transaction of nSize bytes that is within the ancestor limits
+    // through it. Returns false if parent has no usable chain; otherwise sets
+    // errString if a descendant limit would be exceeded.
+    bool GetAncestorsFromChain(CTxMemPool::txiter parent, size_t nSize, size_t nLimitDescendants, size_t nLimitDescendantSize,
+        CTxMemPool::setEntries& setAncestors, std::string& errString) EXCLUSIVE_LOCKS_REQUIRED(m_pool.cs);
+
     // Run the policy checks on a given transaction, excluding any script checks.
     // Looks up inputs, calculates feerate, considers replacement, evaluates
     // package limits, etc. As this function can be invoked for "free" by a peer,
     // only tests that are fast should be done here (to avoid CPU DoS).
     bool PreChecks(ATMPArgs& args, Workspace& ws) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
 
+    // Drop the coins spent by tx from m_view. m_view is shared by every
+    // PreChecks of this invocation and keeps the coins of mempool parents it
+    // fetched, so this must be done before checking tx again once mempool
+    // entries may have been replaced or evicted, lest a removed parent still
+    // provide its coins.
+    void ForgetCachedInputs(const CTransaction& tx)
+    {
+        for (const CTxIn& txin : tx.vin) {
+            m_view.Uncache(txin.prevout);
+        }
+    }
+
+    // Pull the coins spent by txns that are not cached yet into the coins
+    // cache ahead of PreChecks, in one pass sorted by outpoint and without
+    // m_pool.cs held. Transactions PreChecks rejects before looking at their
+    // inputs are skipped, so invalid floods cost no disk reads. Fetched coins
+    // are added to the coins_to_uncache of the first transaction spending
+    // them. Only batches gain from this; a single transaction reads its
+    // inputs in PreChecks.
+    void PrefetchInputs(const std::vector<CTransactionRef>& txns, const std::vector<std::vector<COutPoint>*>& vCoinsToUncache) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     // Run the script checks using our policy flags. As this can be slow, we should
     // only invoke this on transactions that have otherwise passed policy checks.
     bool PolicyScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    // Verify the scripts of the inputs ws.m_script_results does not cover
+    // for flags yet, recording every outcome. On failure state is filled in
+    // as CheckInputScripts would and nFailedIn is set to the failing input
+    // (or to the number of inputs if no single input is to blame).
+    bool CheckInputScriptsRecorded(Workspace& ws, TxValidationState& state, unsigned int flags, PrecomputedTransactionData& txdata, size_t& nFailedIn) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    // Verify the script of input nIn with flags and record the outcome
+    bool CheckInputScriptRecorded(Workspace& ws, size_t nIn, unsigned int flags, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     // Re-run the script checks, using consensus flags, and try to cache the
     // result in the scriptcache. This should be done after
     // PolicyScriptChecks(). This requires that all inputs either be in our
@@ -242,13 +2510,14 @@ private:
     // SYSCOIN
     bool CheckFeeRate(size_t package_size, CAmount package_fee, TxValidationState& state, const bool& IsAssetAllocation)
     {
-        CAmount mempoolRejectFee = m_pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(package_size);
+        CAmount mempoolRejectFee = m_pool.GetMinFee(m_policy->m_max_mempool_size).GetFee(package_size);
         if (mempoolRejectFee > 0 && package_fee < mempoolRejectFee) {
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool min fee not met", strprintf("%d < %d", package_fee, mempoolRejectFee));
         }
         // SYSCOIN
-        if (package_fee < ::minRelayTxFee.GetFee(IsAssetAllocation? package_size*2: package_size)) {
-            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "min relay fee not met", strprintf("%d < %d", package_fee, ::minRelayTxFee.GetFee(IsAssetAllocation? package_size*2: package_size)));
+        const CAmount nMinRelayFee = m_policy->GetMinRelayFee(package_size, IsAssetAllocation);
+        if (package_fee < nMinRelayFee) {
+            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "min relay fee not met", strprintf("%d < %d", package_fee, nMinRelayFee));
         }
         return true;
     }
@@ -258,45 +2527,327 @@ private:
     CCoinsViewMemPool m_viewmempool;
     CCoinsView m_dummy;
 
+    // The policy in effect at the time of invocation.
+    const std::shared_ptr<const MempoolPolicy> m_policy;
+
     // The package limits in effect at the time of invocation.
     const size_t m_limit_ancestors;
     const size_t m_limit_ancestor_size;
-    // These may be modified while evaluating a transaction (eg to account for
-    // in-mempool conflicts; see below).
-    size_t m_limit_descendants;
-    size_t m_limit_descendant_size;
+    // PreChecks works on copies of these which may be modified while
+    // evaluating a transaction (eg to account for in-mempool conflicts), so
+    // the same MemPoolAccept can be used for several transactions.
+    const size_t m_limit_descendants;
+    const size_t m_limit_descendant_size;
+
+    // The chain tip this invocation validates against.
+    const std::shared_ptr<const CMempoolTipContext> m_tip;
+
+    // Cleared for batches, whose mempool size is limited once by the caller.
+    bool m_limit_in_finalize{true};
+};
+
+
+
+/**
+
+	part 4
+	Mempool update
+
+**/
+static void LimitMempoolSize(CTxMemPool& pool, size_t limit, std::chrono::seconds age)
+    EXCLUSIVE_LOCKS_REQUIRED(pool.cs, ::cs_main)
+{
+    int expired = pool.Expire(GetTime<std::chrono::seconds>() - age);
+    if (expired != 0) {
+        LogPrint(BCLog::MEMPOOL, "Expired %i transactions from the memory pool\n", expired);
+    }
+
+    std::vector<COutPoint> vNoSpendsRemaining;
+    pool.TrimToSize(limit, &vNoSpendsRemaining);
+    for (const COutPoint& removed : vNoSpendsRemaining)
+        ::ChainstateActive().CoinsTip().Uncache(removed);
+}
+
+/**
+ * Hierarchical timer wheel of mempool entry expiry times, so expiring old
+ * entries costs O(expired) per call instead of a walk from the oldest entry.
+ * Three levels of 256 one second, 256 second and 65536 second slots cover
+ * about 194 days; later timers wait in an overflow list. The wheel keeps the
+ * expiry of the live timer of every entry, and entries leaving the mempool
+ * early cancel theirs through NotifyEntryRemoved: a cancelled timer stays in
+ * its slot until it fires or the slots are compacted, which happens once
+ * cancelled timers outnumber live ones. The wheel is armed with the expiry
+ * age on first use and re-armed from the whole mempool whenever the age
+ * changes.
+ */
+class CMempoolExpiryWheel
+{
+public:
+    // Arm the timer of an entry that entered the mempool at nTime
+    void Insert(const uint256& hash, int64_t nTime);
+    // Cancel the timer of an entry that left the mempool
+    void Cancel(const uint256& hash);
+    // Pop the hashes of all live timers expiring at or before nNow
+    void Advance(int64_t nNow, std::vector<uint256>& vDue);
+    // Whether the timers are armed for age
+    bool IsArmed(std::chrono::seconds age);
+    // Drop all timers and arm for age, following the removals from pool; the
+    // caller inserts every entry again
+    void Reset(std::chrono::seconds age, CTxMemPool& pool);
+    // Stop following the mempool and disarm
+    void Stop();
+
+private:
+    static constexpr int LEVELS = 3;
+    static constexpr int SLOT_BITS = 8;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    /** Below this many timers cancelled ones are left to fire */
+    static constexpr size_t MIN_COMPACT_TIMERS = 1024;
+
+    struct Timer {
+        uint256 m_hash;
+        int64_t m_expiry;
+    };
+
+    bool IsLive(const Timer& timer) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void Place(Timer&& timer) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void Cascade(std::vector<Timer>& vTimers) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    // Drop the cancelled timers from every slot
+    void Compact() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void Clear() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    Mutex m_mutex;
+    std::vector<Timer> m_slots[LEVELS][SLOTS] GUARDED_BY(m_mutex);
+    std::vector<Timer> m_overflow GUARDED_BY(m_mutex);
+    std::vector<Timer> m_due GUARDED_BY(m_mutex);
+    int64_t m_now GUARDED_BY(m_mutex){0};
+    // Expiry of the live timer of every entry
+    std::unordered_map<uint256, int64_t, SaltedTxidHasher> m_live GUARDED_BY(m_mutex);
+    // Timers in the slots, live or cancelled
+    size_t m_timers GUARDED_BY(m_mutex){0};
+    // Expiry age in seconds the timers are armed for, -1 until the first Reset
+    int64_t m_age GUARDED_BY(m_mutex){-1};
+    boost::signals2::scoped_connection m_removed_conn;
 };
 
+CMempoolExpiryWheel g_mempool_expiry_wheel;
+
+static void StopMempoolExpiryTimers()
+{
+    g_mempool_expiry_wheel.Stop();
+}
+
+bool CMempoolExpiryWheel::IsLive(const Timer& timer) const
+{
+    auto it = m_live.find(timer.m_hash);
+    return it != m_live.end() && it->second == timer.m_expiry;
+}
+
+void CMempoolExpiryWheel::Place(Timer&& timer)
+{
+    const int64_t nDelta = timer.m_expiry - m_now;
+    if (nDelta <= 0) {
+        m_due.push_back(std::move(timer));
+        return;
+    }
+    for (int level = 0; level < LEVELS; level++) {
+        if (nDelta < (int64_t{1} << (SLOT_BITS * (level + 1)))) {
+            m_slots[level][(timer.m_expiry >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(std::move(timer));
+            return;
+        }
+    }
+    m_overflow.push_back(std::move(timer));
+}
+
+void CMempoolExpiryWheel::Cascade(std::vector<Timer>& vTimers)
+{
+    std::vector<Timer> vCascade;
+    vCascade.swap(vTimers);
+    for (Timer& timer : vCascade) {
+        Place(std::move(timer));
+    }
+}
+
+void CMempoolExpiryWheel::Compact()
+{
+    // Timers keep their slot, so this needs no re-placing
+    const auto fnDead = [this](const Timer& timer) { return !IsLive(timer); };
+    const auto fnCompact = [&](std::vector<Timer>& vTimers) {
+        vTimers.erase(std::remove_if(vTimers.begin(), vTimers.end(), fnDead), vTimers.end());
+        if (vTimers.empty()) vTimers.shrink_to_fit();
+    };
+    m_timers = 0;
+    for (int level = 0; level < LEVELS; level++) {
+        for (int slot = 0; slot < SLOTS; slot++) {
+            fnCompact(m_slots[level][slot]);
+            m_timers += m_slots[level][slot].size();
+        }
+    }
+    fnCompact(m_overflow);
+    fnCompact(m_due);
+    m_timers += m_overflow.size() + m_due.size();
+}
+
+void CMempoolExpiryWheel::Clear()
+{
+    for (int level = 0; level < LEVELS; level++) {
+        for (int slot = 0; slot < SLOTS; slot++) {
+            m_slots[level][slot].clear();
+        }
+    }
+    m_overflow.clear();
+    m_due.clear();
+    m_timers = 0;
+}
+
+void CMempoolExpiryWheel::Insert(const uint256& hash, int64_t nTime)
+{
+    LOCK(m_mutex);
+    // Not armed yet, the entry is picked up by the first Reset
+    if (m_age < 0) return;
+    // Nothing is pending, so skip the seconds that passed since the last call
+    if (m_live.empty()) m_now = std::max(m_now, GetTime() - 1);
+    const int64_t nExpiry = nTime + m_age;
+    m_live[hash] = nExpiry;
+    Place(Timer{hash, nExpiry});
+    m_timers++;
+}
+
+void CMempoolExpiryWheel::Cancel(const uint256& hash)
+{
+    LOCK(m_mutex);
+    if (m_live.erase(hash) == 0) return;
+    if (m_live.empty()) {
+        Clear();
+    } else if (m_timers > MIN_COMPACT_TIMERS && m_timers > 2 * m_live.size()) {
+        Compact();
+    }
+}
+
+bool CMempoolExpiryWheel::IsArmed(std::chrono::seconds age)
+{
+    LOCK(m_mutex);
+    return m_age == count_seconds(age);
+}
+
+void CMempoolExpiryWheel::Reset(std::chrono::seconds age, CTxMemPool& pool)
+{
+    if (!m_removed_conn.connected()) {
+        m_removed_conn = pool.NotifyEntryRemoved.connect([this](CTransactionRef tx, MemPoolRemovalReason) { Cancel(tx->GetHash()); });
+    }
+    LOCK(m_mutex);
+    Clear();
+    m_live.clear();
+    m_age = count_seconds(age);
+}
+
+void CMempoolExpiryWheel::Stop()
+{
+    m_removed_conn.disconnect();
+    LOCK(m_mutex);
+    Clear();
+    m_live.clear();
+    m_age = -1;
+}
 
+void CMempoolExpiryWheel::Advance(int64_t nNow, std::vector<uint256>& vDue)
+{
+    LOCK(m_mutex);
+    while (!m_live.empty() && m_now < nNow) {
+        const int64_t t = ++m_now;
+        // Move the timers of the slot we enter down a level before the level
+        // 0 slot of this second is popped.
+        if ((t & ((int64_t{1} << (SLOT_BITS * 2)) - 1)) == 0) {
+            Cascade(m_slots[2][(t >> (SLOT_BITS * 2)) & (SLOTS - 1)]);
+            Cascade(m_overflow);
+        }
+        if ((t & (SLOTS - 1)) == 0) {
+            Cascade(m_slots[1][(t >> SLOT_BITS) & (SLOTS - 1)]);
+        }
+        std::vector<Timer>& vSlot = m_slots[0][t & (SLOTS - 1)];
+        for (Timer& timer : vSlot) {
+            m_due.push_back(std::move(timer));
+        }
+        vSlot.clear();
+    }
+    for (const Timer& timer : m_due) {
+        if (!IsLive(timer)) continue;
+        vDue.push_back(timer.m_hash);
+        m_live.erase(timer.m_hash);
+    }
+    m_timers -= m_due.size();
+    m_due.clear();
+    if (m_live.empty()) {
+        // only cancelled timers are left
+        Clear();
+        m_now = std::max(m_now, nNow);
+    }
+}
+
+/** Remove the entries whose expiry timer fired (and their descendants), returning how many were removed */
+static int ExpireMempoolEntries(CTxMemPool& pool, std::chrono::seconds age) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+{
+    AssertLockHeld(pool.cs);
+    if (!g_mempool_expiry_wheel.IsArmed(age)) {
+        // First call, or the expiry changed: arm the timers of every entry
+        g_mempool_expiry_wheel.Reset(age, pool);
+        for (const CTxMemPoolEntry& entry : pool.mapTx) {
+            g_mempool_expiry_wheel.Insert(entry.GetTx().GetHash(), entry.GetTime());
+        }
+    }
+    // CTxMemPool::Expire removes entries older than the cutoff, so timers
+    // fire once they are strictly in the past.
+    const int64_t nCutoff = count_seconds(GetTime<std::chrono::seconds>() - age);
+    std::vector<uint256> vDue;
+    g_mempool_expiry_wheel.Advance(GetTime() - 1, vDue);
+    if (vDue.empty()) return 0;
+    CTxMemPool::setEntries toremove;
+    for (const CTxMemPool::txiter it : pool.GetIterSet(std::set<uint256>(vDue.begin(), vDue.end()))) {
+        if (it->GetTime() < nCutoff) {
+            toremove.insert(it);
+        } else {
+            // The entry was re-added after its timer was armed
+            g_mempool_expiry_wheel.Insert(it->GetTx().GetHash(), it->GetTime());
+        }
+    }
+    CTxMemPool::setEntries stage;
+    for (const CTxMemPool::txiter removeit : toremove) {
+        pool.CalculateDescendants(removeit, stage);
+    }
+    pool.RemoveStaged(stage, false, MemPoolRemovalReason::EXPIRY);
+    return stage.size();
+}
 
 /**
-
-	part 4
-	Mempool update
-
-**/
-static void LimitMempoolSize(CTxMemPool& pool, size_t limit, std::chrono::seconds age)
+ * Cheap per-transaction version of LimitMempoolSize: expiry only visits the
+ * entries that are due, and trimming only runs once usage passes the limit,
+ * then evicts in one batch down to trim_percent of it. Evicting below the
+ * limit raises the rolling minimum fee to the feerate of the last package
+ * evicted, so the deeper the trim the higher it goes; trim_percent 100 trims
+ * exactly to the limit, as LimitMempoolSize.
+ */
+static void TrimMempoolAmortized(CTxMemPool& pool, size_t limit, unsigned int trim_percent, std::chrono::seconds age)
     EXCLUSIVE_LOCKS_REQUIRED(pool.cs, ::cs_main)
 {
-    int expired = pool.Expire(GetTime<std::chrono::seconds>() - age);
+    int expired = ExpireMempoolEntries(pool, age);
     if (expired != 0) {
         LogPrint(BCLog::MEMPOOL, "Expired %i transactions from the memory pool\n", expired);
     }
 
+    if (pool.DynamicMemoryUsage() <= limit) return;
     std::vector<COutPoint> vNoSpendsRemaining;
-    pool.TrimToSize(limit, &vNoSpendsRemaining);
+    pool.TrimToSize(limit / 100 * trim_percent, &vNoSpendsRemaining);
     for (const COutPoint& removed : vNoSpendsRemaining)
         ::ChainstateActive().CoinsTip().Uncache(removed);
 }
 
-static bool IsCurrentForFeeEstimation() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+static bool IsCurrentForFeeEstimation(const CMempoolTipContext& tip)
 {
-    AssertLockHeld(cs_main);
-    if (::ChainstateActive().IsInitialBlockDownload())
+    if (tip.m_initial_block_download)
         return false;
-    if (::ChainActive().Tip()->GetBlockTime() < (GetTime() - MAX_FEE_ESTIMATION_TIP_AGE))
+    if (tip.m_block_time < (GetTime() - MAX_FEE_ESTIMATION_TIP_AGE))
         return false;
-    if (::ChainActive().Height() < pindexBestHeader->nHeight - 1)
+    if (tip.m_height < tip.m_best_header_height - 1)
         return false;
     return true;
 }
@@ -314,9 +2865,23 @@ static bool IsCurrentForFeeEstimation() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
  * and instead just erase from the mempool as needed.
  */
 
+static Mutex g_reorg_stats_mutex;
+static MempoolReorgStats g_reorg_stats GUARDED_BY(g_reorg_stats_mutex);
+
+MempoolReorgStats GetMempoolReorgStats()
+{
+    LOCK(g_reorg_stats_mutex);
+    return g_reorg_stats;
+}
+
 static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool, bool fAddToMempool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs)
 {
     AssertLockHeld(cs_main);
+    const int64_t nTimeStart = GetTimeMicros();
+    const size_t nDisconnected = disconnectpool.queuedTx.size();
+    size_t nRemoved = 0;
+    MempoolReorgStats stats;
+    stats.m_peak_usage = mempool.DynamicMemoryUsage();
     std::vector<uint256> vHashUpdate;
     // disconnectpool's insertion_order index sorts the entries from
     // oldest to newest, but the oldest entry will be the last tx from the
@@ -324,33 +2889,69 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
     // Iterate disconnectpool in reverse, so that we add transactions
     // back to the mempool starting with the earliest transaction that had
     // been previously seen in a block.
+    std::vector<CTransactionRef> vtxResurrect;
     auto it = disconnectpool.queuedTx.get<insertion_order>().rbegin();
     while (it != disconnectpool.queuedTx.get<insertion_order>().rend()) {
-        // ignore validation errors in resurrected transactions
-        TxValidationState stateDummy;
-        if (!fAddToMempool || (*it)->IsCoinBase() ||
-            !AcceptToMemoryPool(mempool, stateDummy, *it,
-                                nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */)) {
+        if (!fAddToMempool || (*it)->IsCoinBase()) {
             // If the transaction doesn't make it in to the mempool, remove any
             // transactions that depend on it (which would now be orphans).
             mempool.removeRecursive(**it, MemPoolRemovalReason::REORG);
-        } else if (mempool.exists((*it)->GetHash())) {
-            vHashUpdate.push_back((*it)->GetHash());
+            nRemoved++;
+        } else {
+            vtxResurrect.push_back(*it);
         }
         ++it;
     }
+    // The whole set is admitted in one batch, generation by generation, with
+    // the scripts of each generation checked in parallel.
+    if (!vtxResurrect.empty()) {
+        // ignore validation errors in resurrected transactions
+        std::vector<TxValidationState> vStateDummy;
+        std::vector<bool> vAccepted;
+        AcceptToMemoryPoolBatchImpl(mempool, vtxResurrect, vStateDummy, vAccepted, true /* bypass_limits */, {} /* vAbsurdFee */,
+            false /* test_accept */, nullptr /* pvReplaced */, true /* fPoolLocked */);
+        for (size_t i = 0; i < vtxResurrect.size(); i++) {
+            if (!vAccepted[i]) {
+                mempool.removeRecursive(*vtxResurrect[i], MemPoolRemovalReason::REORG);
+                nRemoved++;
+            } else if (mempool.exists(vtxResurrect[i]->GetHash())) {
+                vHashUpdate.push_back(vtxResurrect[i]->GetHash());
+            }
+        }
+    }
     disconnectpool.queuedTx.clear();
+    int64_t nTimeStage = GetTimeMicros();
+    stats.m_resurrect_micros = nTimeStage - nTimeStart;
+    stats.m_peak_usage = std::max<uint64_t>(stats.m_peak_usage, mempool.DynamicMemoryUsage());
     // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
     // no in-mempool children, which is generally not true when adding
     // previously-confirmed transactions back to the mempool.
     // UpdateTransactionsFromBlock finds descendants of any transactions in
     // the disconnectpool that were added back and cleans up the mempool state.
     mempool.UpdateTransactionsFromBlock(vHashUpdate);
+    stats.m_update_micros = GetTimeMicros() - nTimeStage;
+    nTimeStage += stats.m_update_micros;
+    stats.m_peak_usage = std::max<uint64_t>(stats.m_peak_usage, mempool.DynamicMemoryUsage());
 
     // We also need to remove any now-immature transactions
     mempool.removeForReorg(&::ChainstateActive().CoinsTip(), ::ChainActive().Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+    stats.m_remove_micros = GetTimeMicros() - nTimeStage;
+    nTimeStage += stats.m_remove_micros;
     // Re-limit mempool size, in case we added any transactions
-    LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
+    const std::shared_ptr<const MempoolPolicy> policy = GetMempoolPolicy();
+    LimitMempoolSize(mempool, policy->m_max_mempool_size, policy->m_expiry);
+    stats.m_limit_micros = GetTimeMicros() - nTimeStage;
+    stats.m_total_micros = GetTimeMicros() - nTimeStart;
+    if (nDisconnected > 0) {
+        LogPrintf("%s: %u disconnected transactions, %u back in the mempool, %u dropped with their descendants, %.2fms\n", __func__,
+            nDisconnected, vHashUpdate.size(), nRemoved, stats.m_total_micros * MILLI);
+        stats.m_disconnected = nDisconnected;
+        stats.m_resurrected = vHashUpdate.size();
+        stats.m_dropped = nRemoved;
+        LOCK(g_reorg_stats_mutex);
+        stats.m_reorgs = g_reorg_stats.m_reorgs + 1;
+        g_reorg_stats = stats;
+    }
 }
 
 
@@ -361,6 +2962,31 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
 	Pre check and final reception
 
 **/
+bool MemPoolAccept::GetAncestorsFromChain(CTxMemPool::txiter parent, size_t nSize, size_t nLimitDescendants, size_t nLimitDescendantSize,
+    CTxMemPool::setEntries& setAncestors, std::string& errString)
+{
+    const CMempoolAncestorChains::LinkPtr chain = g_mempool_ancestor_chains.Get(m_pool, parent, m_tip->m_hash);
+    if (!chain || chain->m_depth != parent->GetCountWithAncestors()) return false;
+    const Optional<CTxMemPool::txiter> root = m_pool.GetIter(chain->m_root);
+    if (!root) return false;
+    if ((*root)->GetCountWithDescendants() + 1 > nLimitDescendants) {
+        errString = strprintf("too many descendants for tx %s [limit: %u]", chain->m_root.ToString(), nLimitDescendants);
+        return true;
+    }
+    if ((*root)->GetSizeWithDescendants() + nSize > nLimitDescendantSize) {
+        errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", chain->m_root.ToString(), nLimitDescendantSize);
+        return true;
+    }
+    CTxMemPool::setEntries setChain;
+    for (const CMempoolAncestorChains::Link* link = chain.get(); link; link = link->m_parent.get()) {
+        const Optional<CTxMemPool::txiter> mi = m_pool.GetIter(link->m_hash);
+        if (!mi) return false;
+        setChain.insert(*mi);
+    }
+    setAncestors = std::move(setChain);
+    return true;
+}
+
 bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
 {
     const CTransactionRef& ptx = ws.m_ptx;
@@ -374,22 +3000,30 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     const CAmount& nAbsurdFee = args.m_absurd_fee;
     std::vector<COutPoint>& coins_to_uncache = args.m_coins_to_uncache;
 
+    size_t nLimitDescendants = m_limit_descendants;
+    size_t nLimitDescendantSize = m_limit_descendant_size;
+
     // Alias what we need out of ws
-    std::set<uint256>& setConflicts = ws.m_conflicts;
+    CSmallFlatSet<2, uint256>& setConflicts = ws.m_conflicts;
     CTxMemPool::setEntries& allConflicting = ws.m_all_conflicting;
     CTxMemPool::setEntries& setAncestors = ws.m_ancestors;
-    std::unique_ptr<CTxMemPoolEntry>& entry = ws.m_entry;
+    CMempoolEntryPtr& entry = ws.m_entry;
     bool& fReplacementTransaction = ws.m_replacement_transaction;
     CAmount& nModifiedFees = ws.m_modified_fees;
     CAmount& nConflictingFees = ws.m_conflicting_fees;
     size_t& nConflictingSize = ws.m_conflicting_size;
 
-    if (nTPSTestingStartTime > 0)
-    {
-        const int64_t &currentTime = GetTimeMicros();
-        if(currentTime >= nTPSTestingStartTime)
-            vecTPSTestReceivedTimesMempool.emplace_back(hash, currentTime);
+    // is it already in the memory pool?
+    if (m_pool.exists(hash)) {
+        return state.Invalid(TxValidationResult::TX_CONFLICT, "txn-already-in-mempool");
     }
+
+    // was it rejected against the current tip already? Transactions resurrected
+    // by a reorg are always looked at again.
+    if (!bypass_limits && g_recent_rejects.Contains(m_tip->m_hash, tx.GetWitnessHash())) {
+        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-recently-rejected");
+    }
+
     if (!CheckTransaction(tx, state))
         return false; // state filled in by CheckTransaction
         
@@ -415,17 +3049,16 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
         return state.Invalid(TxValidationResult::TX_PREMATURE_SPEND, "non-final");
 
-    // is it already in the memory pool?
-    if (m_pool.exists(hash)) {
-        return state.Invalid(TxValidationResult::TX_CONFLICT, "txn-already-in-mempool");
-    }
-    
     // SYSCOIN
     bool bDuplicate = false;
 	int tolerance = 0;
-	queue doublespendingQueue;
-    // Check for conflicts with in-memory transactions
+    // Check for conflicts with in-memory transactions. The opt-out status of
+    // every conflicting transaction, and whether the sender of tx may double
+    // spend, are only worked out once however many inputs conflict.
     const bool& IsAssetAllocation = IsAssetAllocationTx(tx.nVersion);
+    std::map<const CTransaction*, bool> mapReplacementOptOut;
+    // SYSCOIN
+    Optional<bool> fSenderMayDoubleSpend;
     for (const CTxIn &txin : tx.vin)
     {
         const CTransaction* ptxConflicting = m_pool.GetConflictTx(txin.prevout);
@@ -444,42 +3077,42 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
                 // first-seen mempool behavior should be checking all
                 // unconfirmed ancestors anyway; doing otherwise is hopelessly
                 // insecure.
-                bool fReplacementOptOut = true;
-                
-                for (const CTxIn &_txin : ptxConflicting->vin)
-                {
-                    if (_txin.nSequence <= MAX_BIP125_RBF_SEQUENCE)
+                auto itOptOut = mapReplacementOptOut.find(ptxConflicting);
+                if (itOptOut == mapReplacementOptOut.end()) {
+                    bool fReplacementOptOut = true;
+                    for (const CTxIn &_txin : ptxConflicting->vin)
                     {
-                        fReplacementOptOut = false;
-                        break;
+                        if (_txin.nSequence <= MAX_BIP125_RBF_SEQUENCE)
+                        {
+                            fReplacementOptOut = false;
+                            break;
+                        }
                     }
+                    itOptOut = mapReplacementOptOut.emplace(ptxConflicting, fReplacementOptOut).first;
                 }
                 
-                if (fReplacementOptOut) {
+                if (itOptOut->second) {
                     if(!args.m_test_accept && IsAssetAllocation){
-                        CAssetAllocation theAssetAlloction(tx);
-                        if(theAssetAlloction.assetAllocationTuple.IsNull()){
-                            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
-                        }
-                        ActorSet actorSet;
-                        GetActorsFromAssetAllocationTx(theAssetAlloction, tx.nVersion, true, false, actorSet);
-                        if(actorSet.size() == 1)
-                        {
-                            LOCK(cs_assetallocationconflicts);
-							if(assetAllocationConflicts.find(*actorSet.begin()) == assetAllocationConflicts.end())
-                            {
-                                // Add conflicting sender, control the number of doublespendings
-                                args.m_duplicate = true;
-								doublespendingQueue.add(txin);
-								tolerance++;
-								if(tolerance>MAX_DOUBLE_SPENDING_LIMITATION)
-									break;
+                        if(!fSenderMayDoubleSpend){
+                            // a single sender that has not double spent yet may, once (ZDAG)
+                            fSenderMayDoubleSpend = false;
+                            CAssetAllocation theAssetAlloction(tx);
+                            if(!theAssetAlloction.assetAllocationTuple.IsNull()){
+                                ActorSet actorSet;
+                                GetActorsFromAssetAllocationTx(theAssetAlloction, tx.nVersion, true, false, actorSet);
+                                if(actorSet.size() == 1){
+                                    fSenderMayDoubleSpend = !AssetAllocationHasConflict(GetAssetAllocationConflictActor(theAssetAlloction, tx.nVersion));
+                                }
                             }
-                            else
-                                return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
                         }
-                        else
+                        if(!*fSenderMayDoubleSpend)
                             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
+                        // Add conflicting sender, control the number of doublespendings
+                        args.m_duplicate = true;
+						ws.m_double_spends.push_back({hash, ptxConflicting->GetHash(), txin.prevout, nAcceptTime});
+						tolerance++;
+						if(tolerance>MAX_DOUBLE_SPENDING_LIMITATION)
+							break;
                     }
                     else
                         return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
@@ -568,8 +3201,8 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         }
     }
 
-    entry.reset(new CTxMemPoolEntry(ptx, nFees, nAcceptTime, ::ChainActive().Height(),
-            fSpendsCoinbase, nSigOpsCost, lp));
+    entry = MakeMempoolEntry(ptx, nFees, nAcceptTime, m_tip->m_height,
+            fSpendsCoinbase, nSigOpsCost, lp);
     unsigned int nSize = entry->GetTxSize();
 
     if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
@@ -584,7 +3217,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         return state.Invalid(TxValidationResult::TX_NOT_STANDARD,
                 "absurdly-high-fee", strprintf("%d > %d", nFees, nAbsurdFee));
 
-    const CTxMemPool::setEntries setIterConflicting = m_pool.GetIterSet(setConflicts);
+    const CTxMemPool::setEntries setIterConflicting = GetIterSet(setConflicts);
     // Calculate in-mempool ancestors, up to a limit.
     if (setConflicts.size() == 1) {
         // In general, when we receive an RBF transaction with mempool conflicts, we want to know whether we
@@ -612,20 +3245,42 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         // CalculateMempoolAncestors by assuming the new transaction being added is a new descendant, with no
         // removals, of each parent's existing dependent set). The ancestor count limits are unmodified (as
         // the ancestor limits should be the same for both our new transaction and any conflicts).
-        // We don't bother incrementing m_limit_descendants by the full removal count as that limit never comes
+        // We don't bother incrementing nLimitDescendants by the full removal count as that limit never comes
         // into force here (as we're only adding a single transaction).
         assert(setIterConflicting.size() == 1);
         CTxMemPool::txiter conflict = *setIterConflicting.begin();
 
-        m_limit_descendants += 1;
-        m_limit_descendant_size += conflict->GetSizeWithDescendants();
+        nLimitDescendants += 1;
+        nLimitDescendantSize += conflict->GetSizeWithDescendants();
     }
 
+    // The mempool keeps the ancestor count and size of every entry, so the
+    // direct in-mempool parents of tx bound the result of the ancestor walk
+    // from below. A transaction that is over the limits through one of its
+    // parents is rejected, or let in by the carve-out, without any walk. A
+    // single parent that heads an ancestor chain settles the rest, again
+    // without a walk.
+    CSmallFlatSet<4, uint256> setParentHashes;
+    for (const CTxIn& txin : tx.vin) {
+        setParentHashes.insert(txin.prevout.hash);
+    }
+    const CTxMemPool::setEntries setParents = GetIterSet(setParentHashes);
     std::string errString;
-    if (!m_pool.CalculateMemPoolAncestors(*entry, setAncestors, m_limit_ancestors, m_limit_ancestor_size, m_limit_descendants, m_limit_descendant_size, errString)) {
+    for (CTxMemPool::txiter parent : setParents) {
+        if (parent->GetCountWithAncestors() + 1 > m_limit_ancestors) {
+            errString = strprintf("too many unconfirmed ancestors [limit: %u]", m_limit_ancestors);
+            break;
+        }
+        if (parent->GetSizeWithAncestors() + nSize > m_limit_ancestor_size) {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", m_limit_ancestor_size);
+            break;
+        }
+    }
+    if (errString.empty() && !(setParents.size() == 1 && GetAncestorsFromChain(*setParents.begin(), nSize, nLimitDescendants, nLimitDescendantSize, setAncestors, errString))) {
+        m_pool.CalculateMemPoolAncestors(*entry, setAncestors, m_limit_ancestors, m_limit_ancestor_size, nLimitDescendants, nLimitDescendantSize, errString);
+    }
+    if (!errString.empty()) {
         setAncestors.clear();
-        // If CalculateMemPoolAncestors fails second time, we want the original error string.
-        std::string dummy_err_string;
         // Contracting/payment channels CPFP carve-out:
         // If the new transaction is relatively small (up to 40k weight)
         // and has at most one ancestor (ie ancestor limit of 2, including
@@ -637,10 +3292,21 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         // to be secure by simply only having two immediately-spendable
         // outputs - one for each counterparty. For more info on the uses for
         // this, see https://lists.linuxfoundation.org/pipermail/bitcoin-dev/2018-November/016518.html
-        if (nSize >  EXTRA_DESCENDANT_TX_SIZE_LIMIT ||
-                !m_pool.CalculateMemPoolAncestors(*entry, setAncestors, 2, m_limit_ancestor_size, m_limit_descendants + 1, m_limit_descendant_size + EXTRA_DESCENDANT_TX_SIZE_LIMIT, dummy_err_string)) {
+        //
+        // A single parent without ancestors of its own is the only possible
+        // ancestor set then, so its aggregates decide the same limits
+        // CalculateMemPoolAncestors would check with an ancestor limit of 2.
+        if (nSize > EXTRA_DESCENDANT_TX_SIZE_LIMIT || setParents.size() != 1) {
+            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-long-mempool-chain", errString);
+        }
+        const CTxMemPool::txiter parent = *setParents.begin();
+        if (parent->GetCountWithAncestors() != 1 ||
+                parent->GetSizeWithAncestors() + nSize > m_limit_ancestor_size ||
+                parent->GetCountWithDescendants() + 1 > nLimitDescendants + 1 ||
+                parent->GetSizeWithDescendants() + nSize > nLimitDescendantSize + EXTRA_DESCENDANT_TX_SIZE_LIMIT) {
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-long-mempool-chain", errString);
         }
+        setAncestors.insert(parent);
     }
 
     // A transaction that spends outputs that would be replaced by it is invalid. Now
@@ -673,7 +3339,6 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     {
         CFeeRate newFeeRate(nModifiedFees, nSize);
         std::set<uint256> setConflictsParents;
-        const int maxDescendantsToVisit = 100;
         for (const auto& mi : setIterConflicting) {
             // Don't allow the replacement to reduce the feerate of the
             // mempool.
@@ -709,7 +3374,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         // This potentially overestimates the number of actual descendants
         // but we just want to be conservative to avoid doing too much
         // work.
-        if (nConflictingCount <= maxDescendantsToVisit) {
+        if (nConflictingCount <= MAX_REPLACEMENT_EVICTIONS) {
             // If not too many to replace, then calculate the set of
             // transactions that would have to be evicted
             for (CTxMemPool::txiter it : setIterConflicting) {
@@ -724,7 +3389,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
                     strprintf("rejecting replacement %s; too many potential replacements (%d > %d)\n",
                         hash.ToString(),
                         nConflictingCount,
-                        maxDescendantsToVisit));
+                        MAX_REPLACEMENT_EVICTIONS));
         }
 
         for (unsigned int j = 0; j < tx.vin.size(); j++)
@@ -764,13 +3429,13 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         // Finally in addition to paying more fees than the conflicts the
         // new transaction must pay for its own bandwidth.
         CAmount nDeltaFees = nModifiedFees - nConflictingFees;
-        if (nDeltaFees < ::incrementalRelayFee.GetFee(nSize))
+        if (nDeltaFees < m_policy->m_incremental_relay_fee.GetFee(nSize))
         {
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "insufficient fee",
                     strprintf("rejecting replacement %s, not enough additional fees to relay; %s < %s",
                         hash.ToString(),
                         FormatMoney(nDeltaFees),
-                        FormatMoney(::incrementalRelayFee.GetFee(nSize))));
+                        FormatMoney(m_policy->m_incremental_relay_fee.GetFee(nSize))));
         }
     }
     return true;
@@ -789,7 +3454,7 @@ bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
     const CAmount& nConflictingFees = ws.m_conflicting_fees;
     const size_t& nConflictingSize = ws.m_conflicting_size;
     const bool fReplacementTransaction = ws.m_replacement_transaction;
-    std::unique_ptr<CTxMemPoolEntry>& entry = ws.m_entry;
+    CMempoolEntryPtr& entry = ws.m_entry;
 
     // Remove conflicting transactions from the mempool
     for (CTxMemPool::txiter it : allConflicting)
@@ -811,30 +3476,622 @@ bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
     // - the transaction is not dependent on any other transactions in the mempool
     // SYSCOIN
     // - the transaction does not have a duplicate input from an asset allocation transaction
-    bool validForFeeEstimation = !args.m_duplicate && !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && m_pool.HasNoInputsOf(tx);
+    bool validForFeeEstimation = !args.m_duplicate && !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation(*m_tip) && m_pool.HasNoInputsOf(tx);
 
     // Store transaction in memory
     m_pool.addUnchecked(*entry, setAncestors, validForFeeEstimation);
+    g_mempool_expiry_wheel.Insert(hash, entry->GetTime());
 
     // trim mempool and check if tx was trimmed
-    if (!bypass_limits) {
-        LimitMempoolSize(m_pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
+    if (!bypass_limits && m_limit_in_finalize) {
+        TrimMempoolAmortized(m_pool, m_policy->m_max_mempool_size, m_policy->m_trim_percent, m_policy->m_expiry);
         if (!m_pool.exists(hash))
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
     }
     return true;
 }
 
+/** Memory the block transaction offset tables may use */
+static const size_t BLOCK_TX_OFFSETS_CACHE_SIZE = 16 << 20;
+
+/**
+ * Where every transaction of recently read blocks starts, relative to the
+ * start of the block data, so GetTransaction can read the one transaction it
+ * is after instead of deserializing the whole block. Tables are built lazily:
+ * the first lookup into a block walks it with CBlockTxStream only up to the
+ * transaction, the second walks all of it and adds the table, later lookups
+ * seek. A table holds 12 bytes per transaction,
+ * sorted by the cheap hash of the txid; a cheap hash collision only costs an
+ * extra read, as the read transaction is checked against the txid. Tables are
+ * evicted least recently used first.
+ */
+class CBlockTxOffsets
+{
+public:
+    /** Offsets of the transactions of a block, by the cheap hash of their txid, in any order */
+    typedef std::vector<std::pair<uint64_t, uint32_t>> Table;
+
+    void Add(const uint256& block_hash, Table table);
+    /**
+     * Return false if the offsets of the block are not known, otherwise
+     * append the offsets of the transactions that may be txid to vOffsets.
+     */
+    bool Find(const uint256& block_hash, const uint256& txid, std::vector<uint32_t>& vOffsets);
+    /**
+     * Return whether a lookup into a block without a table should build it,
+     * which is the case once the block was looked up before
+     */
+    bool WantTable(const uint256& block_hash);
+
+private:
+    /** Blocks remembered as looked up once */
+    static constexpr size_t MAX_LOOKED_UP_BLOCKS = 1024;
+
+    struct Entry {
+        Table m_table;
+        std::list<uint256>::iterator m_lru;
+    };
+    static size_t TableUsage(const Table& table) { return table.capacity() * sizeof(Table::value_type) + sizeof(Entry) + sizeof(uint256); }
+
+    Mutex m_mutex;
+    std::unordered_map<uint256, Entry, BlockHasher> m_blocks GUARDED_BY(m_mutex);
+    // least recently used block first
+    std::list<uint256> m_lru GUARDED_BY(m_mutex);
+    size_t m_usage GUARDED_BY(m_mutex){0};
+    // blocks looked up once without a table, oldest first
+    std::deque<uint256> m_looked_up GUARDED_BY(m_mutex);
+    std::unordered_set<uint256, BlockHasher> m_looked_up_set GUARDED_BY(m_mutex);
+};
+
+CBlockTxOffsets g_block_tx_offsets;
+
+void CBlockTxOffsets::Add(const uint256& block_hash, Table table)
+{
+    if (table.empty()) return;
+    std::sort(table.begin(), table.end());
+    table.shrink_to_fit();
+
+    LOCK(m_mutex);
+    if (m_blocks.count(block_hash)) return;
+    const size_t nUsage = TableUsage(table);
+    while (!m_lru.empty() && m_usage + nUsage > BLOCK_TX_OFFSETS_CACHE_SIZE) {
+        auto it = m_blocks.find(m_lru.front());
+        m_usage -= TableUsage(it->second.m_table);
+        m_blocks.erase(it);
+        m_lru.pop_front();
+    }
+    Entry& entry = m_blocks[block_hash];
+    entry.m_table = std::move(table);
+    entry.m_lru = m_lru.insert(m_lru.end(), block_hash);
+    m_usage += nUsage;
+}
+
+bool CBlockTxOffsets::WantTable(const uint256& block_hash)
+{
+    LOCK(m_mutex);
+    if (m_looked_up_set.erase(block_hash)) {
+        m_looked_up.erase(std::find(m_looked_up.begin(), m_looked_up.end(), block_hash));
+        return true;
+    }
+    if (m_looked_up.size() >= MAX_LOOKED_UP_BLOCKS) {
+        m_looked_up_set.erase(m_looked_up.front());
+        m_looked_up.pop_front();
+    }
+    m_looked_up.push_back(block_hash);
+    m_looked_up_set.insert(block_hash);
+    return false;
+}
+
+bool CBlockTxOffsets::Find(const uint256& block_hash, const uint256& txid, std::vector<uint32_t>& vOffsets)
+{
+    LOCK(m_mutex);
+    auto it = m_blocks.find(block_hash);
+    if (it == m_blocks.end()) return false;
+    m_lru.splice(m_lru.end(), m_lru, it->second.m_lru);
+    const Table& table = it->second.m_table;
+    const uint64_t nCheapHash = txid.GetCheapHash();
+    for (auto itOffset = std::lower_bound(table.begin(), table.end(), std::make_pair(nCheapHash, uint32_t{0}));
+            itOffset != table.end() && itOffset->first == nCheapHash; ++itOffset) {
+        vOffsets.push_back(itOffset->second);
+    }
+    return true;
+}
+
+/**
+ * Streaming reader over the transactions of a block on disk. Every
+ * transaction is parsed straight from the file into a reused buffer holding
+ * its serialization without witness, which is what the txid commits to, so
+ * walking a block builds neither the CBlock nor any CTransaction other than
+ * the ones asked for. Witness data is skipped on disk unless fWithWitness.
+ */
+class CBlockTxStream
+{
+public:
+    CBlockTxStream(const FlatFilePos& pos, bool fWithWitness);
+
+    /** Whether the block header could be read, see GetBlockHash */
+    bool IsValid() const { return m_valid; }
+    const uint256& GetBlockHash() const { return m_block_hash; }
+    /** Parse the next transaction; false at the end of the block or on a read error */
+    bool Next();
+    /** Whether every transaction of the block was parsed */
+    bool IsComplete() const { return m_valid && m_next == m_count; }
+
+    // The transaction parsed by the last call to Next()
+    const uint256& GetTxid() const { return m_txid; }
+    uint32_t GetOffset() const { return m_tx_offset; }
+    /** Whether it has witness data, which GetTransaction only includes if fWithWitness */
+    bool HasWitness() const { return m_has_witness; }
+    CTransactionRef GetTransaction() const;
+
+private:
+    void Read(std::vector<unsigned char>& vch, size_t nSize);
+    void Skip(size_t nSize);
+    uint64_t ReadCompactSize(std::vector<unsigned char>* pvch);
+    void ReadScript(std::vector<unsigned char>* pvch);
+
+    CAutoFile m_file;
+    const bool m_with_witness;
+    bool m_valid{false};
+    uint256 m_block_hash;
+    uint64_t m_count{0};
+    uint64_t m_next{0};
+    uint64_t m_pos{0}; //!< bytes of the block read so far
+
+    uint256 m_txid;
+    uint32_t m_tx_offset{0};
+    bool m_has_witness{false};
+    std::vector<unsigned char> m_tx;      //!< serialization without witness
+    std::vector<unsigned char> m_witness; //!< witness of every input, if kept
+};
+
+CBlockTxStream::CBlockTxStream(const FlatFilePos& pos, bool fWithWitness) :
+    m_file(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION), m_with_witness(fWithWitness)
+{
+    if (m_file.IsNull()) {
+        error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        return;
+    }
+    try {
+        CBlockHeader header;
+        m_file >> header;
+        m_block_hash = header.GetHash();
+        m_count = ::ReadCompactSize(m_file);
+        m_pos = ::GetSerializeSize(header, CLIENT_VERSION) + GetSizeOfCompactSize(m_count);
+        m_valid = true;
+    } catch (const std::exception& e) {
+        error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+}
+
+void CBlockTxStream::Read(std::vector<unsigned char>& vch, size_t nSize)
+{
+    const size_t nOld = vch.size();
+    vch.resize(nOld + nSize);
+    if (nSize > 0) m_file.read((char*)vch.data() + nOld, nSize);
+    m_pos += nSize;
+}
+
+void CBlockTxStream::Skip(size_t nSize)
+{
+    m_file.ignore(nSize);
+    m_pos += nSize;
+}
+
+uint64_t CBlockTxStream::ReadCompactSize(std::vector<unsigned char>* pvch)
+{
+    const uint64_t nSize = ::ReadCompactSize(m_file);
+    m_pos += GetSizeOfCompactSize(nSize);
+    if (pvch) {
+        CVectorWriter(SER_DISK, CLIENT_VERSION, *pvch, pvch->size()) << COMPACTSIZE(nSize);
+    }
+    return nSize;
+}
+
+void CBlockTxStream::ReadScript(std::vector<unsigned char>* pvch)
+{
+    const uint64_t nSize = ReadCompactSize(pvch);
+    if (pvch) {
+        Read(*pvch, nSize);
+    } else {
+        Skip(nSize);
+    }
+}
+
+bool CBlockTxStream::Next()
+{
+    if (!m_valid || m_next == m_count) return false;
+    if (m_pos > std::numeric_limits<uint32_t>::max()) {
+        m_valid = false;
+        return false;
+    }
+    m_tx_offset = m_pos;
+    m_tx.clear();
+    m_witness.clear();
+    try {
+        // See SerializeTransaction/UnserializeTransaction for the layout
+        Read(m_tx, 4); // nVersion
+        uint64_t nInputs = ReadCompactSize(nullptr);
+        bool fWitness = false;
+        if (nInputs == 0) {
+            // extended format: a marker, the flags, then the inputs
+            std::vector<unsigned char> vchFlags;
+            Read(vchFlags, 1);
+            if (vchFlags[0] & ~1) throw std::ios_base::failure("Unknown transaction optional data");
+            fWitness = vchFlags[0] & 1;
+            nInputs = ReadCompactSize(nullptr);
+        }
+        CVectorWriter(SER_DISK, CLIENT_VERSION, m_tx, m_tx.size()) << COMPACTSIZE(nInputs);
+        for (uint64_t i = 0; i < nInputs; i++) {
+            Read(m_tx, 36); // prevout
+            ReadScript(&m_tx);
+            Read(m_tx, 4); // nSequence
+        }
+        const uint64_t nOutputs = ReadCompactSize(&m_tx);
+        for (uint64_t i = 0; i < nOutputs; i++) {
+            Read(m_tx, 8); // nValue
+            ReadScript(&m_tx);
+        }
+        if (fWitness) {
+            std::vector<unsigned char>* pvchWitness = m_with_witness ? &m_witness : nullptr;
+            for (uint64_t i = 0; i < nInputs; i++) {
+                const uint64_t nItems = ReadCompactSize(pvchWitness);
+                for (uint64_t j = 0; j < nItems; j++) {
+                    ReadScript(pvchWitness);
+                }
+            }
+        }
+        Read(m_tx, 4); // nLockTime
+        m_has_witness = fWitness;
+    } catch (const std::exception& e) {
+        error("%s: Deserialize or I/O error - %s in block %s", __func__, e.what(), m_block_hash.ToString());
+        m_valid = false;
+        return false;
+    }
+    m_txid = Hash(m_tx.begin(), m_tx.end());
+    m_next++;
+    return true;
+}
+
+CTransactionRef CBlockTxStream::GetTransaction() const
+{
+    CTransactionRef tx;
+    if (m_witness.empty()) {
+        CDataStream ss(m_tx, SER_DISK, CLIENT_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+        ss >> tx;
+        return tx;
+    }
+    // put the marker, the flags and the witness back in
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss.write((const char*)m_tx.data(), 4);
+    const unsigned char vchMarker[2] = {0, 1};
+    ss.write((const char*)vchMarker, 2);
+    ss.write((const char*)m_tx.data() + 4, m_tx.size() - 8);
+    ss.write((const char*)m_witness.data(), m_witness.size());
+    ss.write((const char*)m_tx.data() + m_tx.size() - 4, 4);
+    ss >> tx;
+    return tx;
+}
+
+static bool ReadTransactionFromDisk(CTransactionRef& tx, const FlatFilePos& pos, uint32_t nOffset)
+{
+    CAutoFile filein(OpenBlockFile(FlatFilePos(pos.nFile, pos.nPos + nOffset), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s + %u", __func__, pos.ToString(), nOffset);
+    try {
+        filein >> tx;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s + %u", __func__, e.what(), pos.ToString(), nOffset);
+    }
+    return true;
+}
+
+/**
+ * Read-only index of the mempool transactions by txid, so that lookups such
+ * as GetTransaction need neither cs_main nor mempool.cs. It is an open
+ * addressing table of atomic pointers, kept up to date by the mempool writers
+ * through NotifyEntryAdded/NotifyEntryRemoved, which fire under mempool.cs.
+ * Readers announce the epoch they start in; whatever a writer unlinks (a
+ * removed entry, or the old table after a resize) is only freed once every
+ * reader that could still see it is gone.
+ */
+class CMempoolTxIndex
+{
+public:
+    ~CMempoolTxIndex();
+
+    void Start(CTxMemPool& pool);
+    void Stop();
+    /** Drop every transaction, for a mempool emptied without NotifyEntryRemoved */
+    void Clear();
+    /**
+     * Return false if the index is not running or out of step with the
+     * mempool; ptx is null on a miss
+     */
+    bool Get(const uint256& txid, CTransactionRef& ptx);
+
+private:
+    struct Node {
+        uint256 m_txid;
+        CTransactionRef m_tx;
+    };
+    struct Table {
+        explicit Table(size_t nSize) : m_slots(new std::atomic<Node*>[nSize]), m_mask(nSize - 1)
+        {
+            for (size_t i = 0; i < nSize; i++) m_slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+        std::unique_ptr<std::atomic<Node*>[]> m_slots;
+        const size_t m_mask;
+        size_t m_used{0};       //!< slots holding a node or a tombstone, writer only
+        size_t m_nodes{0};
+    };
+    struct Retired {
+        uint64_t m_epoch;
+        Node* m_node;
+        Table* m_table;
+    };
+    static constexpr size_t MIN_TABLE_SIZE = 1024;
+    static constexpr size_t READER_SLOTS = 64;
+    static constexpr size_t RECLAIM_BATCH = 64;
+
+    static Node* Tombstone() { static Node tombstone; return &tombstone; }
+
+    void Insert(const CTransactionRef& tx);
+    void Erase(const CTransactionRef& tx);
+    void Place(Table& table, Node* node);
+    void Resize(size_t nSize) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void Retire(Node* node, Table* table) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void Reclaim() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    // Rebuild from the mempool if it was emptied behind the index's back,
+    // returning whether it was
+    bool Resync();
+    size_t Slot(const uint256& txid, const Table& table) const { return m_hasher(txid) & table.m_mask; }
+
+    SaltedTxidHasher m_hasher;
+    std::atomic<bool> m_running{false};
+    CTxMemPool* m_pool{nullptr};
+    std::atomic<Table*> m_table{nullptr};
+    std::atomic<uint64_t> m_epoch{1};
+    /** Epoch each reader started in, 0 if free */
+    mutable std::atomic<uint64_t> m_readers[READER_SLOTS];
+    mutable std::atomic<size_t> m_next_reader{0};
+
+    Mutex m_mutex;
+    std::vector<Retired> m_retired GUARDED_BY(m_mutex);
+    boost::signals2::connection m_added_conn;
+    boost::signals2::connection m_removed_conn;
+};
+
+CMempoolTxIndex::~CMempoolTxIndex()
+{
+    LOCK(m_mutex);
+    Table* table = m_table.load();
+    if (table) {
+        for (size_t i = 0; i <= table->m_mask; i++) {
+            Node* node = table->m_slots[i].load();
+            if (node && node != Tombstone()) delete node;
+        }
+        delete table;
+    }
+    for (const Retired& retired : m_retired) {
+        delete retired.m_node;
+        delete retired.m_table;
+    }
+}
+
+void CMempoolTxIndex::Start(CTxMemPool& pool)
+{
+    // connect and seed under pool.cs so that no mempool change is missed
+    LOCK(pool.cs);
+    {
+        LOCK(m_mutex);
+        if (m_running || m_table.load()) return;
+        for (size_t i = 0; i < READER_SLOTS; i++) m_readers[i].store(0);
+        size_t nSize = MIN_TABLE_SIZE;
+        while (nSize < pool.mapTx.size() * 4) nSize <<= 1;
+        m_table.store(new Table(nSize));
+    }
+    for (const CTxMemPoolEntry& entry : pool.mapTx) {
+        Insert(entry.GetSharedTx());
+    }
+    m_added_conn = pool.NotifyEntryAdded.connect(std::bind(&CMempoolTxIndex::Insert, this, std::placeholders::_1));
+    m_removed_conn = pool.NotifyEntryRemoved.connect(std::bind(&CMempoolTxIndex::Erase, this, std::placeholders::_1));
+    m_pool = &pool;
+    m_running = true;
+}
+
+void CMempoolTxIndex::Stop()
+{
+    // readers fall back to the mempool; memory is kept until destruction
+    // as readers may still be in flight
+    m_running = false;
+    m_added_conn.disconnect();
+    m_removed_conn.disconnect();
+}
+
+void CMempoolTxIndex::Clear()
+{
+    LOCK(m_mutex);
+    Table* table = m_table.load();
+    if (!table) return;
+    m_table.store(new Table(MIN_TABLE_SIZE));
+    for (size_t i = 0; i <= table->m_mask; i++) {
+        Node* node = table->m_slots[i].load(std::memory_order_relaxed);
+        if (node && node != Tombstone()) Retire(node, nullptr);
+    }
+    Retire(nullptr, table);
+}
+
+bool CMempoolTxIndex::Resync()
+{
+    // every change to the index happens under pool.cs, so the sizes agree
+    // unless CTxMemPool::clear() ran
+    LOCK(m_pool->cs);
+    if (m_table.load()->m_nodes == m_pool->mapTx.size()) return false;
+    Clear();
+    for (const CTxMemPoolEntry& entry : m_pool->mapTx) {
+        Insert(entry.GetSharedTx());
+    }
+    return true;
+}
+
+bool CMempoolTxIndex::Get(const uint256& txid, CTransactionRef& ptx)
+{
+    if (!m_running) return false;
+    // claim a reader slot, starting from a per thread one
+    static thread_local size_t nReader = m_next_reader++ % READER_SLOTS;
+    const uint64_t nEpoch = m_epoch.load();
+    std::atomic<uint64_t>* pReader = nullptr;
+    for (size_t i = 0; i < READER_SLOTS; i++) {
+        uint64_t nFree = 0;
+        std::atomic<uint64_t>& reader = m_readers[(nReader + i) % READER_SLOTS];
+        if (reader.compare_exchange_strong(nFree, nEpoch)) {
+            pReader = &reader;
+            break;
+        }
+    }
+    // every slot busy, let the caller take the locked path
+    if (!pReader) return false;
+
+    ptx.reset();
+    const Table* table = m_table.load();
+    for (size_t i = Slot(txid, *table), n = 0; n <= table->m_mask; i = (i + 1) & table->m_mask, n++) {
+        const Node* node = table->m_slots[i].load();
+        if (!node) break;
+        if (node != Tombstone() && node->m_txid == txid) {
+            ptx = node->m_tx;
+            break;
+        }
+    }
+    pReader->store(0);
+    // a clear only removes, so only a hit can be stale; misses stay lock free
+    if (ptx && Resync()) {
+        ptx.reset();
+        return false;
+    }
+    return true;
+}
+
+void CMempoolTxIndex::Place(Table& table, Node* node)
+{
+    for (size_t i = Slot(node->m_txid, table); ; i = (i + 1) & table.m_mask) {
+        Node* slot = table.m_slots[i].load(std::memory_order_relaxed);
+        if (!slot) {
+            table.m_used++;
+        } else if (slot != Tombstone()) {
+            continue;
+        }
+        table.m_slots[i].store(node);
+        table.m_nodes++;
+        return;
+    }
+}
+
+void CMempoolTxIndex::Insert(const CTransactionRef& tx)
+{
+    LOCK(m_mutex);
+    Table* table = m_table.load();
+    const uint256& txid = tx->GetHash();
+    for (size_t i = Slot(txid, *table); ; i = (i + 1) & table->m_mask) {
+        Node* node = table->m_slots[i].load(std::memory_order_relaxed);
+        if (!node) break;
+        if (node != Tombstone() && node->m_txid == txid) return;
+    }
+    // keep at least half of the slots empty so that misses stay short
+    if ((table->m_used + 1) * 2 > table->m_mask + 1) {
+        size_t nSize = MIN_TABLE_SIZE;
+        while (nSize < (table->m_nodes + 1) * 4) nSize <<= 1;
+        Resize(nSize);
+        table = m_table.load();
+    }
+    Place(*table, new Node{txid, tx});
+}
+
+void CMempoolTxIndex::Erase(const CTransactionRef& tx)
+{
+    LOCK(m_mutex);
+    Table* table = m_table.load();
+    const uint256& txid = tx->GetHash();
+    for (size_t i = Slot(txid, *table); ; i = (i + 1) & table->m_mask) {
+        Node* node = table->m_slots[i].load(std::memory_order_relaxed);
+        if (!node) return;
+        if (node != Tombstone() && node->m_txid == txid) {
+            table->m_slots[i].store(Tombstone());
+            table->m_nodes--;
+            Retire(node, nullptr);
+            break;
+        }
+    }
+    // shrink once the mempool has drained
+    if (table->m_mask + 1 > MIN_TABLE_SIZE && table->m_nodes * 16 < table->m_mask + 1) {
+        Resize((table->m_mask + 1) / 4);
+    }
+}
+
+void CMempoolTxIndex::Resize(size_t nSize)
+{
+    Table* table = m_table.load();
+    Table* newtable = new Table(nSize);
+    for (size_t i = 0; i <= table->m_mask; i++) {
+        Node* node = table->m_slots[i].load(std::memory_order_relaxed);
+        if (node && node != Tombstone()) Place(*newtable, node);
+    }
+    m_table.store(newtable);
+    Retire(nullptr, table);
+}
+
+void CMempoolTxIndex::Retire(Node* node, Table* table)
+{
+    // readers that announce the new epoch can no longer reach what was unlinked
+    m_retired.push_back({++m_epoch, node, table});
+    if (m_retired.size() >= RECLAIM_BATCH) Reclaim();
+}
+
+void CMempoolTxIndex::Reclaim()
+{
+    uint64_t nOldest = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 0; i < READER_SLOTS; i++) {
+        const uint64_t nEpoch = m_readers[i].load();
+        if (nEpoch != 0) nOldest = std::min(nOldest, nEpoch);
+    }
+    // m_retired is in epoch order
+    auto it = m_retired.begin();
+    for (; it != m_retired.end() && it->m_epoch <= nOldest; ++it) {
+        delete it->m_node;
+        delete it->m_table;
+    }
+    m_retired.erase(m_retired.begin(), it);
+}
+
+static CMempoolTxIndex g_mempool_tx_index;
+
+void StartMempoolTxIndex(CTxMemPool& pool)
+{
+    g_mempool_tx_index.Start(pool);
+}
+
+void StopMempoolTxIndex()
+{
+    g_mempool_tx_index.Stop();
+}
+
+void ClearMempoolTxIndex()
+{
+    g_mempool_tx_index.Clear();
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
  */
 bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus::Params& consensusParams, uint256& hashBlock, const CBlockIndex* const block_index)
 {
-    LOCK(cs_main);
-
     if (!block_index) {
-        CTransactionRef ptx = mempool.get(hash);
+        // neither lookup needs cs_main; a miss in the index needs no lock at all
+        CTransactionRef ptx;
+        if (!g_mempool_tx_index.Get(hash, ptx)) {
+            ptx = mempool.get(hash);
+        }
         if (ptx) {
             txOut = ptx;
             return true;
@@ -844,15 +4101,55 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
             return g_txindex->FindTx(hash, hashBlock, txOut);
         }
     } else {
-        CBlock block;
-        if (ReadBlockFromDisk(block, block_index, consensusParams)) {
-            for (const auto& tx : block.vtx) {
-                if (tx->GetHash() == hash) {
-                    txOut = tx;
+        LOCK(cs_main);
+        // Read just the transaction if we know where it is in the block
+        std::vector<uint32_t> vOffsets;
+        const bool fHaveTable = g_block_tx_offsets.Find(block_index->GetBlockHash(), hash, vOffsets);
+        if (fHaveTable) {
+            const FlatFilePos pos = block_index->GetBlockPos();
+            bool fReadFailed = false;
+            for (const uint32_t nOffset : vOffsets) {
+                CTransactionRef ptx;
+                if (!ReadTransactionFromDisk(ptx, pos, nOffset)) {
+                    fReadFailed = true;
+                    break;
+                }
+                if (ptx->GetHash() == hash) {
+                    txOut = ptx;
                     hashBlock = block_index->GetBlockHash();
                     return true;
                 }
             }
+            // the table was made from the block itself, so it is not there
+            if (!fReadFailed) return false;
+        }
+        // Otherwise walk the block on disk. The walk stops at the transaction
+        // unless the block was looked up before, in which case it goes on to
+        // the end to build the table, so the next lookups in it can seek.
+        const bool fBuildTable = !fHaveTable && g_block_tx_offsets.WantTable(block_index->GetBlockHash());
+        CBlockTxStream stream(block_index->GetBlockPos(), false /* fWithWitness */);
+        if (!stream.IsValid() || stream.GetBlockHash() != block_index->GetBlockHash()) {
+            return error("%s: failed to read block %s", __func__, block_index->GetBlockHash().ToString());
+        }
+        CBlockTxOffsets::Table table;
+        CTransactionRef ptx;
+        while (stream.Next()) {
+            if (fBuildTable) table.emplace_back(stream.GetTxid().GetCheapHash(), stream.GetOffset());
+            if (!ptx && stream.GetTxid() == hash) {
+                // the walk skips witness data, so a transaction with some is read again
+                if (!stream.HasWitness()) {
+                    ptx = stream.GetTransaction();
+                } else if (!ReadTransactionFromDisk(ptx, block_index->GetBlockPos(), stream.GetOffset())) {
+                    return false;
+                }
+                if (!fBuildTable) break;
+            }
+        }
+        if (fBuildTable && stream.IsComplete()) g_block_tx_offsets.Add(block_index->GetBlockHash(), std::move(table));
+        if (ptx) {
+            txOut = ptx;
+            hashBlock = block_index->GetBlockHash();
+            return true;
         }
     }
 